@@ -261,6 +261,18 @@ public:
   bool SetPWMBits(uint8_t value);
   uint8_t pwmbits();   // return the pwm-bits of the currently active buffer.
 
+  // Change Options::limit_refresh_rate_hz (<= 0 for no limit) and
+  // Options::pwm_dither_bits (0..2) while the refresh thread is running,
+  // e.g. to adapt to the content. Picked up with the next refresh.
+  // Returns boolean to signify if value was within range.
+  bool SetLimitRefreshRate(int limit_refresh_hz);
+  bool SetPWMDitherBits(int value);
+
+  // Microseconds the last refresh took to write the frame to the panel,
+  // without the wait for the refresh limit. 0 if the refresh thread is not
+  // running yet.
+  uint32_t LastDumpMicros();
+
   // Map brightness of output linearly to input with CIE1931 profile.
   void set_luminance_correct(bool on);
   bool luminance_correct() const;
@@ -335,8 +347,33 @@ private:
 
 namespace internal {
 class Framebuffer;
+struct PaletteBits;
 }
 
+// Up to 256 colors for palette-indexed content, see
+// FrameCanvas::SetPixelsIndexed().
+//
+// Each color is mapped to its bitplane bits once per kind of pixel (set of
+// color gpio bits, e.g. upper and lower half of a panel) on first use, and
+// again only if brightness, luminance correction or the pixel mapping change.
+// Drawing an index is then a table lookup and one OR per bitplane instead of
+// the color mapping per pixel.
+// Not thread-safe: use a palette from one thread at a time.
+class FramePalette {
+public:
+  FramePalette(const Color *colors, int count);
+  ~FramePalette();
+
+  int size() const;
+
+private:
+  friend class internal::Framebuffer;
+  FramePalette(const FramePalette &) = delete;
+  FramePalette &operator=(const FramePalette &) = delete;
+
+  internal::PaletteBits *const bits_;
+};
+
 class FrameCanvas : public Canvas {
 public:
   // Set PWM bits used for this Frame.
@@ -377,6 +414,11 @@ public:
   // Copy content from other FrameCanvas owned by the same RGBMatrix.
   void CopyFrom(const FrameCanvas &other);
 
+  // Set the width x height pixels at (x,y) from row-major palette indices.
+  // Pixels with an index outside the palette are left unchanged.
+  void SetPixelsIndexed(int x, int y, int width, int height,
+                        const FramePalette &palette, const uint8_t *indices);
+
   // -- Canvas interface.
   virtual int width() const;
   virtual int height() const;
@@ -18,10 +18,13 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <vector>
+
 #include "hardware-mapping.h"
 #include "../include/graphics.h"
 
 namespace rgb_matrix {
+class FramePalette;
 class GPIO;
 class PinPulser;
 namespace internal {
@@ -60,6 +63,21 @@ private:
   PixelDesignator *const buffer_;
 };
 
+// Bitplane bits of the colors of a FramePalette, see
+// Framebuffer::SetPixelsIndexed()
+struct PaletteBits {
+  std::vector<Color> colors;
+
+  // Settings the tables were prepared for.
+  const PixelDesignatorMap *mapper = NULL;
+  uint8_t brightness = 0;
+  bool luminance_correct = false;
+
+  std::vector<uint8_t> pixel_class;  // Per pixel of mapper; kNoClass if unused.
+  std::vector<gpio_bits_t> bits;     // [class][color][kBitPlanes]
+  enum { kNoClass = 0xff };
+};
+
 // Internal representation of the frame-buffer that as well can
 // write itself to GPIO.
 // Our internal memory layout mimicks as much as possible what needs to be
@@ -128,6 +146,8 @@ public:
   int height() const;
   void SetPixel(int x, int y, uint8_t red, uint8_t green, uint8_t blue);
   void SetPixels(int x, int y, int width, int height, Color *colors);
+  void SetPixelsIndexed(int x, int y, int width, int height,
+                        const FramePalette &palette, const uint8_t *indices);
   void Clear();
   void Fill(uint8_t red, uint8_t green, uint8_t blue);
 
@@ -146,6 +166,7 @@ private:
                              PixelDesignator *designator);
   inline void  MapColors(uint8_t r, uint8_t g, uint8_t b,
                          uint16_t *red, uint16_t *green, uint16_t *blue);
+  void PreparePalette(PaletteBits *palette);
   const int rows_;     // Number of rows. 16 or 32.
   const int parallel_; // Parallel rows of chains. 1 or 2.
   const int height_;   // rows * parallel
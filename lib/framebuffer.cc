@@ -31,6 +31,7 @@
 
 #include "gpio.h"
 #include "../include/graphics.h"
+#include "../include/led-matrix.h"
 
 namespace rgb_matrix {
 namespace internal {
@@ -702,6 +703,88 @@ void Framebuffer::SetPixels(int x, int y, int width, int height, Color *colors)
     }
   }
 }
+
+// Pixels differ only in which gpio bits their colors drive, so every color
+// gets one set of bitplane words per distinct (r_bit, g_bit, b_bit).
+void Framebuffer::PreparePalette(PaletteBits *palette) {
+  PixelDesignatorMap *mapper = *shared_mapper_;
+  const int colors = palette->colors.size();
+  std::vector<const PixelDesignator *> classes;
+  palette->pixel_class.assign(mapper->width() * mapper->height(),
+                              PaletteBits::kNoClass);
+  for (int y = 0; y < mapper->height(); ++y) {
+    for (int x = 0; x < mapper->width(); ++x) {
+      const PixelDesignator *d = mapper->get(x, y);
+      if (d->gpio_word < 0) continue;
+      size_t c = 0;
+      while (c < classes.size()
+             && (classes[c]->r_bit != d->r_bit || classes[c]->g_bit != d->g_bit
+                 || classes[c]->b_bit != d->b_bit))
+        ++c;
+      if (c == classes.size()) {
+        if (c == PaletteBits::kNoClass) continue;  // Can't happen with <= 6 parallel.
+        classes.push_back(d);
+      }
+      palette->pixel_class[y * mapper->width() + x] = c;
+    }
+  }
+
+  palette->bits.resize(classes.size() * colors * kBitPlanes);
+  gpio_bits_t *out = palette->bits.data();
+  for (size_t c = 0; c < classes.size(); ++c) {
+    for (int i = 0; i < colors; ++i) {
+      const Color &color = palette->colors[i];
+      uint16_t red, green, blue;
+      MapColors(color.r, color.g, color.b, &red, &green, &blue);
+      for (int bit = 0; bit < kBitPlanes; ++bit) {
+        const uint16_t mask = 1 << bit;
+        gpio_bits_t plane_bits = 0;
+        if (red & mask)   plane_bits |= classes[c]->r_bit;
+        if (green & mask) plane_bits |= classes[c]->g_bit;
+        if (blue & mask)  plane_bits |= classes[c]->b_bit;
+        *out++ = plane_bits;
+      }
+    }
+  }
+
+  palette->mapper = mapper;
+  palette->brightness = brightness_;
+  palette->luminance_correct = do_luminance_correct_;
+}
+
+void Framebuffer::SetPixelsIndexed(int x, int y, int width, int height,
+                                   const FramePalette &palette,
+                                   const uint8_t *indices) {
+  PaletteBits *p = palette.bits_;
+  PixelDesignatorMap *mapper = *shared_mapper_;
+  if (p->mapper != mapper || p->brightness != brightness_
+      || p->luminance_correct != do_luminance_correct_) {
+    PreparePalette(p);
+  }
+
+  const int colors = p->colors.size();
+  const int min_bit_plane = kBitPlanes - pwm_bits_;
+  const size_t class_stride = colors * kBitPlanes;
+  for (int iy = y; iy < y + height; ++iy) {
+    for (int ix = x; ix < x + width; ++ix) {
+      const uint8_t index = *indices++;
+      const PixelDesignator *designator = mapper->get(ix, iy);
+      if (designator == NULL || index >= colors) continue;
+      const uint8_t c = p->pixel_class[iy * mapper->width() + ix];
+      if (c == PaletteBits::kNoClass) continue;
+
+      gpio_bits_t *bits = bitplane_buffer_ + designator->gpio_word
+        + columns_ * min_bit_plane;
+      const gpio_bits_t *color_bits = p->bits.data() + c * class_stride
+        + index * kBitPlanes + min_bit_plane;
+      const gpio_bits_t designator_mask = designator->mask;
+      for (int bit = min_bit_plane; bit < kBitPlanes; ++bit) {
+        *bits = (*bits & designator_mask) | *color_bits++;
+        bits += columns_;
+      }
+    }
+  }
+}
 // Strange LED-mappings such as RBG or so are handled here.
 gpio_bits_t Framebuffer::GetGpioFromLedSequence(char col,
                                                 const char *led_sequence,
@@ -79,6 +79,10 @@ public:
   bool SetPWMBits(uint8_t value);
   uint8_t pwmbits();   // return the pwm-bits of the currently active buffer.
 
+  bool SetLimitRefreshRate(int limit_refresh_hz);
+  bool SetPWMDitherBits(int value);
+  uint32_t LastDumpMicros();
+
   void set_luminance_correct(bool on);
   bool luminance_correct() const;
 
@@ -123,13 +127,24 @@ public:
                int pwm_dither_bits, bool show_refresh,
                int limit_refresh_hz, bool allow_busy_waiting)
     : io_(io), show_refresh_(show_refresh),
-      target_frame_usec_(limit_refresh_hz < 1 ? 0 : 1e6/limit_refresh_hz),
       allow_busy_waiting_(allow_busy_waiting),
       running_(true),
       current_frame_(initial_frame), next_frame_(NULL),
-      requested_frame_multiple_(1) {
+      requested_frame_multiple_(1), last_dump_usec_(0) {
     pthread_cond_init(&frame_done_, NULL);
     pthread_cond_init(&input_change_, NULL);
+    SetLimitRefreshRate(limit_refresh_hz);
+    SetPWMDitherBits(pwm_dither_bits);
+  }
+
+  // Refresh tuning; picked up by the refresh loop at the next refresh.
+  void SetLimitRefreshRate(int limit_refresh_hz) {
+    MutexLock l(&frame_sync_);
+    target_frame_usec_ = limit_refresh_hz < 1 ? 0 : 1e6/limit_refresh_hz;
+  }
+
+  void SetPWMDitherBits(int pwm_dither_bits) {
+    MutexLock l(&frame_sync_);
     switch (pwm_dither_bits) {
     case 0:
       start_bit_[0] = 0; start_bit_[1] = 0;
@@ -146,6 +161,11 @@ public:
     }
   }
 
+  uint32_t LastDumpMicros() {
+    MutexLock l(&frame_sync_);
+    return last_dump_usec_;
+  }
+
   void Stop() {
     MutexLock l(&running_mutex_);
     running_ = false;
@@ -163,15 +183,28 @@ public:
     uint32_t initial_holdoff_start = GetMicrosecondCounter();
     bool max_measure_enabled = false;
 
+    // Local copies of the tuning, updated with the SwapOnVSync() exchange.
+    uint32_t target_frame_usec;
+    uint32_t start_bit[4];
+    {
+      MutexLock l(&frame_sync_);
+      target_frame_usec = target_frame_usec_;
+      memcpy(start_bit, start_bit_, sizeof(start_bit));
+    }
+
     while (running()) {
       const uint32_t start_time_us = GetMicrosecondCounter();
 
       current_frame_->framebuffer()
-        ->DumpToMatrix(io_, start_bit_[low_bit_sequence % 4]);
+        ->DumpToMatrix(io_, start_bit[low_bit_sequence % 4]);
+      const uint32_t dump_usec = GetMicrosecondCounter() - start_time_us;
 
       // SwapOnVSync() exchange.
       {
         MutexLock l(&frame_sync_);
+        last_dump_usec_ = dump_usec;
+        target_frame_usec = target_frame_usec_;
+        memcpy(start_bit, start_bit_, sizeof(start_bit));
         // Do fast equality test first (likely due to frame_count reset).
         if (frame_count == requested_frame_multiple_
             || frame_count % requested_frame_multiple_ == 0) {
@@ -198,14 +231,14 @@ public:
       ++frame_count;
       ++low_bit_sequence;
 
-      if (target_frame_usec_) {
+      if (target_frame_usec) {
         if (allow_busy_waiting_) {
-          while ((GetMicrosecondCounter() - start_time_us) < target_frame_usec_) {
+          while ((GetMicrosecondCounter() - start_time_us) < target_frame_usec) {
             // busy wait. We have our dedicated core, so ok to burn cycles.
           }
         } else {
           long spent_us = GetMicrosecondCounter() - start_time_us;
-          SleepMicroseconds(target_frame_usec_ - spent_us);
+          SleepMicroseconds(target_frame_usec - spent_us);
         }
       }
 
@@ -249,9 +282,7 @@ private:
 
   GPIO *const io_;
   const bool show_refresh_;
-  const uint32_t target_frame_usec_;
   const bool allow_busy_waiting_;
-  uint32_t start_bit_[4];
 
   Mutex running_mutex_;
   bool running_;
@@ -265,6 +296,9 @@ private:
   FrameCanvas *current_frame_;
   FrameCanvas *next_frame_;
   unsigned requested_frame_multiple_;
+  uint32_t target_frame_usec_;
+  uint32_t start_bit_[4];
+  uint32_t last_dump_usec_;
 };
 
 // Some defaults. See options-initialize.cc for the command line parsing.
@@ -554,6 +588,23 @@ bool RGBMatrix::Impl::SetPWMBits(uint8_t value) {
 }
 uint8_t RGBMatrix::Impl::pwmbits() { return params_.pwm_bits; }
 
+bool RGBMatrix::Impl::SetLimitRefreshRate(int limit_refresh_hz) {
+  params_.limit_refresh_rate_hz = limit_refresh_hz;
+  if (updater_) updater_->SetLimitRefreshRate(limit_refresh_hz);
+  return true;
+}
+
+bool RGBMatrix::Impl::SetPWMDitherBits(int value) {
+  if (value < 0 || value > 2) return false;
+  params_.pwm_dither_bits = value;
+  if (updater_) updater_->SetPWMDitherBits(value);
+  return true;
+}
+
+uint32_t RGBMatrix::Impl::LastDumpMicros() {
+  return updater_ ? updater_->LastDumpMicros() : 0;
+}
+
 // Map brightness of output linearly to input with CIE1931 profile.
 void RGBMatrix::Impl::set_luminance_correct(bool on) {
   active_->framebuffer()->set_luminance_correct(on);
@@ -724,6 +775,14 @@ bool RGBMatrix::ApplyPixelMapper(const PixelMapper *mapper) {
 bool RGBMatrix::SetPWMBits(uint8_t value) { return impl_->SetPWMBits(value); }
 uint8_t RGBMatrix::pwmbits() { return impl_->pwmbits(); }
 
+bool RGBMatrix::SetLimitRefreshRate(int limit_refresh_hz) {
+  return impl_->SetLimitRefreshRate(limit_refresh_hz);
+}
+bool RGBMatrix::SetPWMDitherBits(int value) {
+  return impl_->SetPWMDitherBits(value);
+}
+uint32_t RGBMatrix::LastDumpMicros() { return impl_->LastDumpMicros(); }
+
 void RGBMatrix::set_luminance_correct(bool on) {
   return impl_->set_luminance_correct(on);
 }
@@ -806,4 +865,16 @@ bool FrameCanvas::Deserialize(const char *data, size_t len) {
 void FrameCanvas::CopyFrom(const FrameCanvas &other) {
   frame_->CopyFrom(other.frame_);
 }
+void FrameCanvas::SetPixelsIndexed(int x, int y, int width, int height,
+                                   const FramePalette &palette,
+                                   const uint8_t *indices) {
+  frame_->SetPixelsIndexed(x, y, width, height, palette, indices);
+}
+
+FramePalette::FramePalette(const Color *colors, int count)
+  : bits_(new internal::PaletteBits()) {
+  bits_->colors.assign(colors, colors + std::max(0, std::min(count, 256)));
+}
+FramePalette::~FramePalette() { delete bits_; }
+int FramePalette::size() const { return bits_->colors.size(); }
 }  // end namespace rgb_matrix
@@ -0,0 +1,117 @@
+/*
+* Offline dithering for low pwm-bits, see ./anim-dither.h
+*/
+
+#include "anim-dither.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#define DITHER_BIT_PLANES 11 // rgb_matrix::internal::Framebuffer::kBitPlanes
+#define DITHER_SPATIAL 0.75f // share of the error kept in the slice
+#define DITHER_NEXT_SLICE 0.125f // share to the same pixel of the next slice
+#define DITHER_NEXT_FRAME 0.125f // share to the same pixel and slice of the next frame
+
+// same as luminance_cie1931() in lib/framebuffer.cc
+static uint16_t LuminanceCIE1931(uint8_t c, uint8_t brightness)
+{
+  float out_factor = ((1 << DITHER_BIT_PLANES) - 1);
+  float v = (float) c * brightness / 255.0;
+  return roundf(out_factor * ((v <= 8) ? v / 902.3 : pow((v + 16) / 116.0, 3)));
+}
+
+AnimDither::AnimDither(int pwm_bits, int brightness)
+  : level_(256),
+    error_(SLICE_ROWS * SLICE_COLS * 3),
+    slice_carry_(SLICE_ROWS * SLICE_COLS * 3, 0),
+    frame_carry_((size_t)SLICE_COUNT * SLICE_ROWS * SLICE_COLS * 3, 0)
+{
+  pwm_bits = std::max(1, std::min(DITHER_BIT_PLANES, pwm_bits));
+  brightness = std::max(1, std::min(100, brightness));
+  const uint16_t mask = ~((1 << (DITHER_BIT_PLANES - pwm_bits)) - 1);
+
+  // the lowest value reaching each level that remains after dropping the low planes
+  for( int c = 0; c < 256; c++ )
+  {
+    const uint16_t level = LuminanceCIE1931(c, brightness);
+    level_[c] = level;
+    const uint16_t shown = level & mask;
+    if( shown_.empty() || shown_.back() != shown )
+    {
+      shown_.push_back(shown);
+      code_.push_back(c);
+    }
+  }
+}
+
+uint8_t AnimDither::Quantize(float level, float *shown) const
+{
+  size_t i = std::lower_bound(shown_.begin(), shown_.end(), level) - shown_.begin();
+  if( i == shown_.size() ) i--;
+  else if( i > 0 && level - shown_[i - 1] < shown_[i] - level ) i--;
+  *shown = shown_[i];
+  return code_[i];
+}
+
+void AnimDither::ApplySlice(Slice *slice, float *frame_carry)
+{
+  const size_t n = SLICE_ROWS * SLICE_COLS * 3;
+  for( size_t i = 0; i < n; i++ )
+  {
+    error_[i] = slice_carry_[i] + frame_carry[i];
+    slice_carry_[i] = 0;
+  }
+
+  // too much carried error only smears, a level step is enough to dither with
+  const float limit = shown_.size() > 1 ? shown_[1] : 1;
+
+  for( int y = 0; y < SLICE_ROWS; ++y )
+  {
+    const bool forward = (y & 1) == 0;
+    const int dir = forward ? 1 : -1;
+    for( int i = 0; i < SLICE_COLS; ++i )
+    {
+      const int x = forward ? i : SLICE_COLS - 1 - i;
+      Pixel &p = slice->pixels[y * SLICE_COLS + x];
+      unsigned char *channel[3] = { &p.r, &p.g, &p.b };
+      const bool black = p.r == 0 && p.g == 0 && p.b == 0;
+
+      for( int c = 0; c < 3; c++ )
+      {
+        const size_t at = (y * SLICE_COLS + x) * 3 + c;
+        if( black )
+        {
+          frame_carry[at] = 0;
+          continue;
+        }
+
+        float shown;
+        const float want = level_[*channel[c]] + error_[at];
+        *channel[c] = Quantize(want, &shown);
+        const float err = std::max(-limit, std::min(limit, want - shown));
+
+        slice_carry_[at] = err * DITHER_NEXT_SLICE;
+        frame_carry[at] = err * DITHER_NEXT_FRAME;
+
+        const float e = err * DITHER_SPATIAL;
+        const bool ahead = forward ? x + 1 < SLICE_COLS : x > 0;
+        const bool behind = forward ? x > 0 : x + 1 < SLICE_COLS;
+        if( ahead ) error_[at + dir * 3] += e * 7 / 16;
+        if( y + 1 < SLICE_ROWS )
+        {
+          const size_t below = at + SLICE_COLS * 3;
+          if( behind ) error_[below - dir * 3] += e * 3 / 16;
+          error_[below] += e * 5 / 16;
+          if( ahead ) error_[below + dir * 3] += e * 1 / 16;
+        }
+      }
+    }
+  }
+}
+
+void AnimDither::Apply(SimpleFrame *frame)
+{
+  for( size_t k = 0; k < SLICE_COUNT; k++ )
+    ApplySlice(&frame->slices[k], &frame_carry_[k * SLICE_ROWS * SLICE_COLS * 3]);
+}
@@ -0,0 +1,45 @@
+/*
+* Quantizes frames ahead of time for a viewer running with low --led-pwm-bits
+*
+* The matrix maps 8 bit colors through the CIE1931 curve to kBitPlanes (11) bit
+* levels and then only shows the top pwm-bits planes, so neighbouring colors
+* collapse into bands. Here each color channel is replaced by a color that
+* survives that truncation, and the rounding error is diffused in light level:
+* spatially within a slice (Floyd-Steinberg, serpentine), to the same pixel of the
+* next slice, and to the same pixel of that slice in the next frame.
+*
+* Black pixels stay black and swallow their error, so empty space doesn't sparkle.
+* Frames have to be passed in display order.
+*/
+
+#ifndef ANIM_DITHER_H
+#define ANIM_DITHER_H
+
+#include "anim-format.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+class AnimDither
+{
+public:
+  // `pwm_bits` and `brightness` as given to the viewer
+  AnimDither(int pwm_bits, int brightness = 100);
+
+  void Apply(SimpleFrame *frame);
+
+private:
+  void ApplySlice(Slice *slice, float *frame_carry);
+  uint8_t Quantize(float level, float *shown) const;
+
+  std::vector<float> level_; // matrix light level of each 8 bit value
+  std::vector<uint16_t> shown_; // distinct levels left after truncation, ascending
+  std::vector<uint8_t> code_; // an 8 bit value showing shown_[i]
+
+  std::vector<float> error_; // current slice
+  std::vector<float> slice_carry_; // to the next slice
+  std::vector<float> frame_carry_; // per slice, to the next frame
+};
+
+#endif
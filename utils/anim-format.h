@@ -0,0 +1,110 @@
+/*
+* .anim file layout, shared by hologram-viewer and img2anim
+*
+* "HOLOGRAM": AnimHeader, then frameCount SimpleFrames
+* "HOLOGRM2": AnimHeader, AnimInfo, then data depending on AnimInfo::encoding
+*   ANIM_RAW:         frameCount SimpleFrames
+*   ANIM_SLICE_TABLE: frameCount * sliceCount uint32_t slice references,
+*                     then tableCount unique Slices
+*   ANIM_PALETTE_TABLE: AnimPalette, then the same as ANIM_SLICE_TABLE with
+*                     IndexedSlices in the table
+*
+* With ANIM_HALF_TURN in AnimInfo::flags, slice k is the plane at pi*k/sliceCount
+* instead of 2*pi*k/sliceCount: the slices cover half a turn, and the panel shows
+* them again from behind, mirrored, for the other half.
+*/
+
+#ifndef ANIM_FORMAT_H
+#define ANIM_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SLICE_ROWS 64
+#define SLICE_COLS 64
+#define SLICE_COUNT 100
+
+#define ANIM_MAGIC "HOLOGRAM"
+#define ANIM_MAGIC_V2 "HOLOGRM2"
+#define ANIM_PALETTE_MAX 256
+
+// used in StreamIO construction
+struct Pixel
+{
+  Pixel() : r(0), g(0), b(0) {}
+  unsigned char r;
+  unsigned char g;
+  unsigned char b;
+  Pixel(unsigned char rn, unsigned char gn, unsigned char bn)
+  {
+    r = rn;
+    g = gn;
+    b = bn;
+  }
+};
+
+// used in StreamIO construction
+struct Slice
+{
+  Pixel pixels[SLICE_ROWS * SLICE_COLS]; //1D collapsed row*COLUMNS + col
+  const Pixel GetPixel(size_t x, size_t y) const
+  {
+    return pixels[ y * SLICE_COLS + x ];
+  }
+  void SetPixel(size_t x, size_t y,
+                unsigned char r,
+                unsigned char g,
+                unsigned char b)
+  {
+    pixels[ y * SLICE_COLS + x ] = Pixel(r,g,b);
+  }
+};
+
+struct SimpleFrame
+{
+  Slice slices[SLICE_COUNT];
+};
+
+// slice of an ANIM_PALETTE_TABLE anim, one AnimPalette index per pixel
+struct IndexedSlice
+{
+  uint8_t indices[SLICE_ROWS * SLICE_COLS]; // same order as Slice::pixels
+};
+
+// .anim file
+struct AnimHeader
+{
+   char magic[9] = ANIM_MAGIC; // to recognize file (8+null)
+   uint32_t frameCount = 0;
+   uint32_t loopStart = 0; // frame to return to after last frame
+};
+
+enum AnimEncoding
+{
+  ANIM_RAW = 0,         // full SimpleFrames
+  ANIM_SLICE_TABLE = 1, // per-frame references into a table of unique slices
+  ANIM_PALETTE_TABLE = 2, // ANIM_SLICE_TABLE of palette indices, 1/3 the size
+};
+
+enum AnimFlags
+{
+  ANIM_HALF_TURN = 1, // slices cover half a turn, mirrored for the other half
+};
+
+// follows AnimHeader in ANIM_MAGIC_V2 files
+struct AnimInfo
+{
+  uint32_t encoding = ANIM_RAW;
+  uint32_t flags = 0; // AnimFlags
+  uint32_t sliceCount = SLICE_COUNT; // slices per frame
+  uint32_t tableCount = 0; // unique slices in the slice table
+};
+
+// follows AnimInfo in ANIM_PALETTE_TABLE files, entries from count on are black
+struct AnimPalette
+{
+  uint32_t count = 0;
+  Pixel colors[ANIM_PALETTE_MAX];
+};
+
+#endif
@@ -0,0 +1,172 @@
+/*
+* Writes .anim files, see ./anim-writer.h
+*/
+
+#include "anim-writer.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// FNV-1a over the slice bytes
+static uint64_t HashSlice(const void *slice, size_t size)
+{
+  const unsigned char *p = reinterpret_cast<const unsigned char*>(slice);
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for( size_t i = 0; i < size; i++ )
+  {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+AnimWriter::AnimWriter(const std::string &path, uint32_t frameCount, uint32_t loopStart, bool dedup,
+                       bool palette, uint32_t flags)
+  : path_(path), part_(path + ".part"),
+    out_(part_, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc),
+    dedup_(dedup), palette_(dedup && palette)
+{
+  header_.frameCount = frameCount;
+  header_.loopStart = loopStart;
+
+  if( !dedup_ )
+  {
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(AnimHeader));
+    return;
+  }
+
+  memcpy(header_.magic, ANIM_MAGIC_V2, sizeof(header_.magic));
+  info_.encoding = palette_ ? ANIM_PALETTE_TABLE : ANIM_SLICE_TABLE;
+  info_.flags = flags;
+  refs_.reserve((size_t)frameCount * SLICE_COUNT);
+
+  // slices go after the palette and reference table, which are filled in by Finish()
+  tableHead_ = sizeof(AnimHeader) + sizeof(AnimInfo) + (palette_ ? sizeof(AnimPalette) : 0)
+               + sizeof(uint32_t) * (size_t)frameCount * SLICE_COUNT;
+  out_.seekp(tableHead_);
+}
+
+AnimWriter::~AnimWriter()
+{
+  if( finished_ ) return;
+  out_.close();
+  unlink(part_.c_str());
+}
+
+uint32_t AnimWriter::AddSlice(const void *slice, size_t size)
+{
+  const uint64_t h = HashSlice(slice, size);
+
+  scratch_.resize(size);
+  auto range = table_.equal_range(h);
+  for( auto it = range.first; it != range.second; ++it )
+  {
+    // confirm against the copy already written
+    out_.seekg(tableHead_ + static_cast<std::streamoff>( size * (size_t)it->second ));
+    out_.read(scratch_.data(), size);
+    if( out_ && memcmp(scratch_.data(), slice, size) == 0 )
+      return it->second;
+    out_.clear();
+  }
+
+  const uint32_t index = info_.tableCount++;
+  out_.seekp(tableHead_ + static_cast<std::streamoff>( size * (size_t)index ));
+  out_.write(reinterpret_cast<const char*>(slice), size);
+  table_.emplace(h, index);
+  return index;
+}
+
+void AnimWriter::Write(const SimpleFrame &frame)
+{
+  if( written_ >= header_.frameCount ) return;
+  written_++;
+
+  if( !dedup_ )
+  {
+    out_.write(reinterpret_cast<const char*>(&frame), sizeof(SimpleFrame));
+    return;
+  }
+
+  for( size_t k = 0; k < SLICE_COUNT; k++ )
+  {
+    if( palette_ )
+    {
+      IndexSlice(frame.slices[k], &indexed_);
+      refs_.push_back(AddSlice(&indexed_, sizeof(IndexedSlice)));
+    }
+    else
+      refs_.push_back(AddSlice(&frame.slices[k], sizeof(Slice)));
+  }
+}
+
+void AnimWriter::IndexSlice(const Slice &slice, IndexedSlice *out)
+{
+  for( size_t i = 0; i < SLICE_ROWS * SLICE_COLS; i++ )
+  {
+    const Pixel &p = slice.pixels[i];
+    const uint32_t rgb = (p.r << 16) | (p.g << 8) | p.b;
+    auto it = color_index_.find(rgb);
+    if( it == color_index_.end() )
+    {
+      if( colors_.count == ANIM_PALETTE_MAX )
+      {
+        overflow_ = true;
+        out->indices[i] = 0;
+        continue;
+      }
+      colors_.colors[colors_.count] = p;
+      it = color_index_.emplace(rgb, colors_.count++).first;
+    }
+    out->indices[i] = it->second;
+  }
+}
+
+bool AnimWriter::Finish()
+{
+  bool complete = Complete();
+  out_.close();
+  complete = complete && !out_.fail();
+  finished_ = true;
+  if( complete && rename(part_.c_str(), path_.c_str()) == 0 ) return true;
+  if( complete ) fprintf(stderr, "Can't move \"%s\" into place: %s\n", part_.c_str(), strerror(errno));
+  // a later run would refuse `path` if a broken anim stayed there
+  unlink(part_.c_str());
+  return false;
+}
+
+bool AnimWriter::Complete()
+{
+  // the header promised frameCount frames, pad with blank ones
+  if( written_ < header_.frameCount )
+  {
+    SimpleFrame *blank = new SimpleFrame();
+    while( written_ < header_.frameCount ) Write(*blank);
+    delete blank;
+  }
+
+  if( !dedup_ ) return !!out_.flush();
+
+  out_.seekp(0);
+  out_.write(reinterpret_cast<const char*>(&header_), sizeof(AnimHeader));
+  out_.write(reinterpret_cast<const char*>(&info_), sizeof(AnimInfo));
+  if( palette_ ) out_.write(reinterpret_cast<const char*>(&colors_), sizeof(AnimPalette));
+  out_.write(reinterpret_cast<const char*>(refs_.data()), sizeof(uint32_t) * refs_.size());
+  out_.flush();
+
+  if( overflow_ )
+  {
+    fprintf(stderr, "More than %d colors, can't be written with a palette\n", ANIM_PALETTE_MAX);
+    return false;
+  }
+
+  const size_t slices = refs_.size();
+  const size_t slice_size = palette_ ? sizeof(IndexedSlice) : sizeof(Slice);
+  const double size = (double)tableHead_ + slice_size * (double)info_.tableCount;
+  if( palette_ ) fprintf(stderr, "%u colors, ", colors_.count);
+  fprintf(stderr, "%u unique of %zu slices (%.1f%%), %.1f MB instead of %.1f MB\n",
+          info_.tableCount, slices, slices ? 100.0 * info_.tableCount / slices : 0.0,
+          size / 1e6, (sizeof(AnimHeader) + sizeof(SimpleFrame) * (double)header_.frameCount) / 1e6);
+  return !!out_;
+}
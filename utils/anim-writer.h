@@ -0,0 +1,69 @@
+/*
+* Writes .anim files (see: ./anim-format.h)
+*
+* By default identical slices are stored once: each slice is hashed, matches are
+* verified against the slice already written, and frames store references into
+* the slice table.
+*
+* With `palette` the table holds palette indices instead of colors
+* (ANIM_PALETTE_TABLE), for content with at most ANIM_PALETTE_MAX colors.
+* `flags` (AnimFlags) go in AnimInfo, e.g. ANIM_HALF_TURN for slices of half a turn.
+*
+* The anim is written to <path>.part and only renamed to `path` by a successful
+* Finish(); a failed or abandoned one is removed, nothing unplayable stays behind.
+*/
+
+#ifndef ANIM_WRITER_H
+#define ANIM_WRITER_H
+
+#include "anim-format.h"
+
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class AnimWriter
+{
+public:
+  // `dedup` false writes the original "HOLOGRAM" layout, which has no room for `palette` or `flags`
+  AnimWriter(const std::string &path, uint32_t frameCount, uint32_t loopStart, bool dedup = true,
+             bool palette = false, uint32_t flags = 0);
+  ~AnimWriter();
+
+  bool ok() const { return !!out_; }
+
+  // append next frame
+  void Write(const SimpleFrame &frame);
+
+  // fill in header and slice references and move the file to `path`; returns false
+  // on write error or when a palette anim had more than ANIM_PALETTE_MAX colors
+  bool Finish();
+
+private:
+  bool Complete();
+  uint32_t AddSlice(const void *slice, size_t size);
+  void IndexSlice(const Slice &slice, IndexedSlice *out);
+
+  const std::string path_;
+  const std::string part_; // written until Finish()
+  bool finished_ = false;
+  std::fstream out_;
+  const bool dedup_;
+  const bool palette_;
+  AnimHeader header_;
+  AnimInfo info_;
+  uint32_t written_ = 0; // frames
+
+  std::vector<uint32_t> refs_;
+  std::unordered_multimap<uint64_t, uint32_t> table_; // slice hash -> table index
+  std::streamoff tableHead_ = 0;
+  std::vector<char> scratch_; // to compare hash matches
+
+  AnimPalette colors_;
+  std::unordered_map<uint32_t, uint8_t> color_index_; // 0xRRGGBB -> palette index
+  bool overflow_ = false; // more colors than the palette holds
+  IndexedSlice indexed_;
+};
+
+#endif
@@ -0,0 +1,19 @@
+/*
+* libswscale setup shared by ./video-viewer.cc and ./img2anim-video.cc
+*
+* Needs libav like both of them (see: ./Makefile)
+*/
+
+#ifndef AV_SCALE_H
+#define AV_SCALE_H
+
+struct AVCodecContext;
+struct SwsContext;
+
+// scaler from the decoded frames of `codec_ctx` to RGB24 at display_width x display_height
+// with the SWS_* `flags`; deprecated YUVJ formats are mapped to YUV with the source range
+// set to full. NULL if libswscale can't convert the format
+SwsContext *CreateSWSContext(const AVCodecContext *codec_ctx,
+                             int display_width, int display_height, int flags);
+
+#endif
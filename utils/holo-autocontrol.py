@@ -1,7 +1,8 @@
 #!/usr/bin/python3
 
 # Sends zeromq strings to LED driver zmq server
-# Reads touch sensor left/right GPIO
+# Reads touch sensor left/right GPIO, unless started with --no-swipe: hologram-viewer -G reads
+# them itself (see ./hologram-swipe.h) and holds the lines, requesting them here would fail
 # IP address of LED driver is read from ./ip.txt and can update while running
 # Sets animation state read from ./state_queue.txt while running
 # For manual control use ./hologram-controller.py
@@ -12,7 +13,6 @@ import time
 import zmq
 import time
 import os
-import gpiod
 import sys
 
 STATE_FILE = "/home/hwteam/SD25App/animation_state.txt"
@@ -21,11 +21,16 @@ STATE_FILE = "/home/hwteam/SD25App/animation_state.txt"
 pin_ri = 6
 pin_le = 13
 
-chip = gpiod.Chip('gpiochip4')
-line_ri = chip.get_line(pin_ri)
-line_le = chip.get_line(pin_le)
-line_ri.request(consumer="input", type=gpiod.LINE_REQ_DIR_IN)
-line_le.request(consumer="input", type=gpiod.LINE_REQ_DIR_IN)
+swipe = "--no-swipe" not in sys.argv[1:]
+if swipe:
+  import gpiod
+  chip = gpiod.Chip('gpiochip4')
+  line_ri = chip.get_line(pin_ri)
+  line_le = chip.get_line(pin_le)
+  line_ri.request(consumer="input", type=gpiod.LINE_REQ_DIR_IN)
+  line_le.request(consumer="input", type=gpiod.LINE_REQ_DIR_IN)
+else:
+  print("Swipe sensors left to hologram-viewer -G")
 
 context = zmq.Context()
 socket = context.socket(zmq.REQ)
@@ -140,7 +145,8 @@ while True:
   #   last_cmd = cmd
   try:
     # check swipe
-    DetectSwipe()
+    if swipe:
+      DetectSwipe()
     # check state
     # time_now = time.time_ns()
     period = period - 1
@@ -0,0 +1,193 @@
+/*
+* Loopback benchmark of the shared memory volume ring (see: ./holo-shm.h)
+*
+* A writer thread fills and publishes whole frames, a reader thread waits on the
+* futex and reads the newest frame the way hologram-viewer's producer does, on a
+* private ring so it runs next to a live viewer. Every frame is filled with one
+* byte value, so a frame the seqlock passed but that mixes two values is reported
+* as inconsistent (that would be a bug, torn frames are only dropped).
+*
+* usage: ./holo-shm-bench [-s <seconds>] [-f <writer fps, 0 = unlimited>]
+*/
+
+#include "holo-shm.h"
+
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SECONDS 5
+#define BENCH_POLL_MS 5 // reader futex timeout, as SHM_POLL_MS in the viewer
+
+struct bench
+{
+  struct holo_shm_ring *ring;
+  int fps;
+  volatile int stop;
+  uint32_t published;
+  uint32_t read, torn, inconsistent, skipped;
+  double latency_sum, latency_max; // publish -> read done, us
+};
+
+static double now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void *writer(void *arg)
+{
+  struct bench *b = (struct bench*)arg;
+  const double interval = b->fps > 0 ? 1e6 / b->fps : 0;
+  double next = now_us();
+  while( !b->stop )
+  {
+    uint8_t *pixels = holo_shm_begin(b->ring);
+    memset(pixels, b->published & 0xff, HOLO_SHM_FRAME_SIZE);
+    const double t = now_us();
+    memcpy(pixels, &t, sizeof(t)); // publish time for the reader
+    holo_shm_publish(b->ring);
+    b->published++;
+
+    if( interval > 0 )
+    {
+      next += interval;
+      const double wait = next - now_us();
+      if( wait > 0 )
+      {
+        struct timespec ts = { (time_t)(wait / 1e6), (long)((long long)wait % 1000000 * 1000) };
+        nanosleep(&ts, NULL);
+      }
+    }
+  }
+  return NULL;
+}
+
+static void *reader(void *arg)
+{
+  struct bench *b = (struct bench*)arg;
+  uint32_t last = 0;
+  uint32_t sum = 0;
+  while( !b->stop )
+  {
+    const uint32_t seen = __atomic_load_n(&b->ring->wake, __ATOMIC_ACQUIRE);
+    const uint32_t head = __atomic_load_n(&b->ring->head, __ATOMIC_ACQUIRE);
+    if( head == last )
+    {
+      struct timespec timeout = { 0, BENCH_POLL_MS * 1000000L };
+      syscall(SYS_futex, &b->ring->wake, FUTEX_WAIT, seen, &timeout, NULL, 0);
+      continue;
+    }
+    if( last != 0 ) b->skipped += head - last - 1;
+
+    const struct holo_shm_slot *slot = &b->ring->slot[(head - 1) % HOLO_SHM_SLOTS];
+    const uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if( seq & 1 )
+    {
+      b->torn++;
+      continue;
+    }
+    // touch every byte once, the viewer's conversion reads the frame once too
+    const uint8_t value = slot->pixels[HOLO_SHM_FRAME_SIZE - 1];
+    int mixed = 0;
+    for( size_t k = sizeof(double); k < HOLO_SHM_FRAME_SIZE; k++ )
+    {
+      sum += slot->pixels[k];
+      mixed |= slot->pixels[k] != value;
+    }
+    double t;
+    memcpy(&t, slot->pixels, sizeof(t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if( __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq )
+    {
+      b->torn++;
+      continue;
+    }
+    if( mixed ) b->inconsistent++;
+
+    const double latency = now_us() - t;
+    b->latency_sum += latency;
+    if( latency > b->latency_max ) b->latency_max = latency;
+    b->read++;
+    last = head;
+  }
+  if( sum == 1 ) printf(" "); // keep the reads
+  return NULL;
+}
+
+static int usage(const char *progname)
+{
+  fprintf(stderr, "usage: %s [options]\n", progname);
+  fprintf(stderr, "Loopback benchmark of the hologram-viewer shared memory ring.\n");
+  fprintf(stderr, "Options:\n"
+          "\t-s <seconds> : run time (default %d)\n"
+          "\t-f <fps>     : limit the writer to this frame rate (default unlimited)\n",
+          BENCH_SECONDS);
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  int seconds = BENCH_SECONDS;
+  struct bench b;
+  memset(&b, 0, sizeof(b));
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:f:")) != -1) {
+    switch (opt) {
+      case 's':
+        seconds = atoi(optarg) > 0 ? atoi(optarg) : 1;
+        break;
+      case 'f':
+        b.fps = atoi(optarg);
+        break;
+      default:
+        return usage(argv[0]);
+    }
+  }
+
+  char name[64];
+  snprintf(name, sizeof(name), "%s-bench-%d", HOLO_SHM_NAME, (int)getpid());
+  struct holo_shm_ring *created = holo_shm_create(name);
+  if( !created )
+  {
+    perror(name);
+    return 1;
+  }
+  holo_shm_close(created);
+  b.ring = holo_shm_open(name); // the way a writer maps it
+  if( !b.ring )
+  {
+    fprintf(stderr, "%s: can't map\n", name);
+    shm_unlink(name);
+    return 1;
+  }
+
+  pthread_t w, r;
+  const double start = now_us();
+  pthread_create(&r, NULL, reader, &b);
+  pthread_create(&w, NULL, writer, &b);
+  sleep(seconds);
+  b.stop = 1;
+  pthread_join(w, NULL);
+  __atomic_add_fetch(&b.ring->wake, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &b.ring->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+  pthread_join(r, NULL);
+  const double elapsed = (now_us() - start) / 1e6;
+
+  printf("%u x %u byte frames in %.2fs\n", b.published, HOLO_SHM_FRAME_SIZE, elapsed);
+  printf("  write  %.1f fps, %.1f MB/s\n", b.published / elapsed, b.published / elapsed * HOLO_SHM_FRAME_SIZE / 1e6);
+  printf("  read   %.1f fps, %u skipped, %u torn dropped, %u inconsistent\n",
+         b.read / elapsed, b.skipped, b.torn, b.inconsistent);
+  printf("  latency publish->read mean %.0fus max %.0fus\n",
+         b.read ? b.latency_sum / b.read : 0, b.latency_max);
+
+  holo_shm_close(b.ring);
+  shm_unlink(name);
+  return b.inconsistent ? 1 : 0;
+}
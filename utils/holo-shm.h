@@ -0,0 +1,140 @@
+/*
+* Shared memory volume ring between external renderers and hologram-viewer -M
+*
+* The viewer creates HOLO_SHM_NAME (/dev/shm/hologram-volume) holding a ring of
+* HOLO_SHM_SLOTS frames in SimpleFrame layout (slices, rows, cols, rgb). A writer
+* fills the slot after the newest one and publishes it; the viewer converts the
+* newest slot straight out of shared memory while playing the anim "live"
+* (HOLO_SHM_ANIM).
+*
+* Each slot is a seqlock: seq is odd while the writer is in it, so a reader that
+* sees seq change (or odd) across its read dropped a torn frame. `wake` is a futex
+* word bumped on every publish; writers that can't call futex (e.g. Python over
+* mmap) may skip the wake, the viewer also polls every few milliseconds.
+*
+* Plain C so renderers can include it:
+*
+*   struct holo_shm_ring *ring = holo_shm_open(HOLO_SHM_NAME);
+*   uint8_t *pixels = holo_shm_begin(ring);   // HOLO_SHM_FRAME_SIZE bytes
+*   render(pixels);
+*   holo_shm_publish(ring);
+*
+* see: ./holo-shm-bench.c for a loopback benchmark
+*/
+
+#ifndef HOLO_SHM_H
+#define HOLO_SHM_H
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define HOLO_SHM_NAME "/hologram-volume"
+#define HOLO_SHM_ANIM "live" // anim name that plays the ring
+#define HOLO_SHM_MAGIC 0x4d485348 // "HSHM"
+#define HOLO_SHM_VERSION 1
+#define HOLO_SHM_SLOTS 3
+#define HOLO_SHM_SLICES 100
+#define HOLO_SHM_ROWS 64
+#define HOLO_SHM_COLS 64
+#define HOLO_SHM_FRAME_SIZE (HOLO_SHM_SLICES * HOLO_SHM_ROWS * HOLO_SHM_COLS * 3)
+
+struct holo_shm_slot
+{
+  uint32_t seq; // odd while written
+  uint32_t frame; // number of the frame in it
+  uint8_t pad[56]; // pixels start on a cache line
+  uint8_t pixels[HOLO_SHM_FRAME_SIZE];
+};
+
+struct holo_shm_ring
+{
+  uint32_t magic; // set last by the creator
+  uint32_t version;
+  uint32_t slices, rows, cols, slots;
+  uint32_t head; // frames published, the newest is in slot[(head - 1) % slots]
+  uint32_t wake; // futex word, bumped on publish
+  uint8_t pad[32];
+  struct holo_shm_slot slot[HOLO_SHM_SLOTS];
+};
+
+// map an existing ring, NULL if there is none or its layout differs
+static inline struct holo_shm_ring *holo_shm_open(const char *name)
+{
+  const int fd = shm_open(name, O_RDWR, 0);
+  if( fd < 0 ) return NULL;
+  void *p = mmap(NULL, sizeof(struct holo_shm_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if( p == MAP_FAILED ) return NULL;
+  struct holo_shm_ring *ring = (struct holo_shm_ring*)p;
+  if( __atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != HOLO_SHM_MAGIC
+      || ring->version != HOLO_SHM_VERSION || ring->slots != HOLO_SHM_SLOTS )
+  {
+    munmap(p, sizeof(struct holo_shm_ring));
+    return NULL;
+  }
+  return ring;
+}
+
+// replace any ring called `name` with a blank one any user may write, NULL on failure
+static inline struct holo_shm_ring *holo_shm_create(const char *name)
+{
+  shm_unlink(name);
+  const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+  if( fd < 0 ) return NULL;
+  fchmod(fd, 0666); // past the umask
+  if( ftruncate(fd, sizeof(struct holo_shm_ring)) != 0 )
+  {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  void *p = mmap(NULL, sizeof(struct holo_shm_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if( p == MAP_FAILED )
+  {
+    shm_unlink(name);
+    return NULL;
+  }
+  struct holo_shm_ring *ring = (struct holo_shm_ring*)p;
+  ring->version = HOLO_SHM_VERSION;
+  ring->slices = HOLO_SHM_SLICES;
+  ring->rows = HOLO_SHM_ROWS;
+  ring->cols = HOLO_SHM_COLS;
+  ring->slots = HOLO_SHM_SLOTS;
+  __atomic_store_n(&ring->magic, HOLO_SHM_MAGIC, __ATOMIC_RELEASE);
+  return ring;
+}
+
+static inline void holo_shm_close(struct holo_shm_ring *ring)
+{
+  munmap(ring, sizeof(struct holo_shm_ring));
+}
+
+// claim the slot after the newest one and return its pixels to fill
+static inline uint8_t *holo_shm_begin(struct holo_shm_ring *ring)
+{
+  const uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  struct holo_shm_slot *slot = &ring->slot[head % HOLO_SHM_SLOTS];
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE); // seq odd before any pixel changes
+  return slot->pixels;
+}
+
+// make the slot from holo_shm_begin() the newest frame and wake the viewer
+static inline void holo_shm_publish(struct holo_shm_ring *ring)
+{
+  const uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  struct holo_shm_slot *slot = &ring->slot[head % HOLO_SHM_SLOTS];
+  slot->frame = head;
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&ring->wake, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &ring->wake, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+#endif
@@ -0,0 +1,210 @@
+/*
+* Simulates one leader and several follower hologram-viewers on this machine,
+* synchronizing over loopback with HoloSync (see: ./hologram-sync.h)
+*
+* Each simulated unit gets its own clock with a random offset and drift, so the
+* followers have to estimate the leader's clock like separate machines would.
+* Reports the true frame change error between leader and followers.
+*
+* usage: ./holo-sync-sim [-n <followers>] [-t <seconds>] [-p <port>] [-f <frame ms>]
+*/
+
+#include "hologram-sync.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define SIM_FRAMES 40 // simulated anim length
+#define SIM_LOOP_START 10
+
+static std::atomic<bool> running(true);
+
+static void InterruptHandler(int signo) {
+  running = false;
+}
+
+// clock of one simulated unit, relative to the real monotonic clock
+struct SimClock
+{
+  uint64_t base;
+  int64_t skew_us;
+  double drift; // 1 + ppm
+
+  uint64_t Now() const
+  {
+    return skew_us + base + (uint64_t)((SyncClockMicros() - base) * drift);
+  }
+};
+
+// a frame change of one unit, in real (monotonic) time
+struct SimTick
+{
+  uint32_t clock;
+  uint64_t real_us;
+  uint32_t index;
+  int32_t phase;
+};
+
+static void RunLeader(HoloSync *sync, const SimClock *clock, uint32_t frame_ms,
+                      std::vector<SimTick> *ticks)
+{
+  SyncState s;
+  s.frame_time_ms = frame_ms;
+  s.frameCount = SIM_FRAMES;
+  s.loopStart = SIM_LOOP_START;
+  snprintf(s.anim, sizeof(s.anim), "sim");
+
+  std::mt19937 rng(1);
+  uint64_t next = clock->Now();
+  while( running )
+  {
+    const uint64_t now = clock->Now();
+    if( now < next )
+    {
+      usleep(200);
+      continue;
+    }
+    next += frame_ms * 1000;
+
+    s.clock++;
+    s.tick_us = now;
+    s.index = AnimFrameAfter(s.index, 1, SIM_FRAMES, SIM_LOOP_START);
+    if( s.clock % 20 == 0 ) s.phase += (int)(rng() % 7) - 3; // a swipe
+    ticks->push_back({ s.clock, SyncClockMicros(), s.index, s.phase });
+    sync->Publish(s);
+  }
+}
+
+static void RunFollower(HoloSync *sync, std::vector<SimTick> *ticks)
+{
+  uint32_t clock = 0;
+  while( running )
+  {
+    SyncTarget t;
+    if( !sync->Expected(sync->Now(), &t) || t.clock == clock )
+    {
+      usleep(200);
+      continue;
+    }
+    const bool first = clock == 0;
+    clock = t.clock;
+    if( first ) continue; // joined mid-frame
+    ticks->push_back({ t.clock, SyncClockMicros(), t.index, t.phase });
+  }
+}
+
+static int usage(const char *progname) {
+  fprintf(stderr, "usage: %s [-n <followers>] [-t <seconds>] [-p <port>] [-f <frame ms>]\n", progname);
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  int followers = 3;
+  int seconds = 10;
+  int port = SYNC_PORT;
+  uint32_t frame_ms = 100;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:t:p:f:")) != -1) {
+    switch (opt) {
+      case 'n':
+        followers = atoi(optarg);
+        break;
+      case 't':
+        seconds = atoi(optarg);
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'f':
+        frame_ms = atoi(optarg);
+        break;
+      default:
+        return usage(argv[0]);
+    }
+  }
+  if( followers < 1 || seconds < 1 || frame_ms < 1 ) return usage(argv[0]);
+
+  signal(SIGTERM, InterruptHandler);
+  signal(SIGINT, InterruptHandler);
+
+  // every unit sees its own time: offsets of seconds, drift of tens of ppm
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int64_t> skew(0, 20000000);
+  std::uniform_real_distribution<double> ppm(-50, 50);
+  const uint64_t base = SyncClockMicros();
+
+  std::vector<SimClock> clocks(followers + 1);
+  std::vector<HoloSync*> units;
+  for( int u = 0; u <= followers; u++ )
+  {
+    clocks[u] = { base, skew(rng), 1.0 + ppm(rng) * 1e-6 };
+    const SimClock *c = &clocks[u];
+    units.push_back(new HoloSync(u == 0 ? HoloSync::SYNC_LEADER : HoloSync::SYNC_FOLLOWER,
+                                 "127.0.0.1", port, [c](){ return c->Now(); }));
+    units.back()->Start();
+  }
+
+  printf("Simulating 1 leader + %d followers for %ds, %ums frames\n", followers, seconds, frame_ms);
+
+  std::vector<std::vector<SimTick>> ticks(followers + 1);
+  std::vector<std::thread> threads;
+  threads.emplace_back(RunLeader, units[0], &clocks[0], frame_ms, &ticks[0]);
+  for( int u = 1; u <= followers; u++ )
+    threads.emplace_back(RunFollower, units[u], &ticks[u]);
+
+  for( int s = 0; s < seconds && running; s++ ) sleep(1);
+
+  // true offset: leader clock minus follower clock at the same instant
+  std::vector<int64_t> offset_error(followers + 1);
+  for( int u = 1; u <= followers; u++ )
+  {
+    const int64_t truth = (int64_t)clocks[0].Now() - (int64_t)clocks[u].Now();
+    offset_error[u] = units[u]->offset_us() - truth;
+  }
+
+  running = false;
+  for( auto &t : threads ) t.join();
+  for( auto *u : units ) delete u;
+
+  const std::vector<SimTick> &leader = ticks[0];
+  for( int u = 1; u <= followers; u++ )
+  {
+    std::vector<int64_t> errors;
+    uint32_t index_mismatch = 0, phase_mismatch = 0;
+    for( const SimTick &t : ticks[u] )
+    {
+      if( leader.empty() || t.clock < leader.front().clock ) continue;
+      const size_t l = t.clock - leader.front().clock;
+      if( l >= leader.size() ) continue;
+      const int64_t e = (int64_t)t.real_us - (int64_t)leader[l].real_us;
+      errors.push_back(e < 0 ? -e : e);
+      if( t.index != leader[l].index ) index_mismatch++;
+      if( t.phase != leader[l].phase ) phase_mismatch++;
+    }
+    if( errors.empty() )
+    {
+      printf("follower %d: never locked\n", u);
+      continue;
+    }
+    std::sort(errors.begin(), errors.end());
+    double sum = 0;
+    for( int64_t v : errors ) sum += v;
+    printf("follower %d: %zu ticks, sync error avg %.0fus p99 %lldus max %lldus, "
+           "offset estimate error %lldus, %u index / %u phase mismatches\n",
+           u, errors.size(), sum / errors.size(), (long long)errors[errors.size() * 99 / 100],
+           (long long)errors.back(), (long long)offset_error[u],
+           index_mismatch, phase_mismatch);
+  }
+
+  return 0;
+}
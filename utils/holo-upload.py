@@ -0,0 +1,67 @@
+#!/usr/bin/python3
+
+# Uploads an .anim file (or raw frames) to hologram-viewer over zeromq and reports throughput
+# The viewer compiles it in the background and plays it by name once done
+# For the upload requests see ./hologram-upload.h
+#
+# usage: ./holo-upload.py <file> [name] [-H host] [-c chunk KiB] [-l loop frame] [-p]
+#   -p: play it once compiled
+
+import argparse
+import os
+import time
+import zmq
+
+parser = argparse.ArgumentParser(description="Upload an anim to hologram-viewer")
+parser.add_argument("file")
+parser.add_argument("name", nargs="?", help="anim name (default: file name without extension)")
+parser.add_argument("-H", "--host", default="localhost")
+parser.add_argument("-P", "--port", type=int, default=5555)
+parser.add_argument("-c", "--chunk", type=int, default=256, help="chunk size in KiB")
+parser.add_argument("-l", "--loop", type=int, default=0, help="loop frame of raw frames")
+parser.add_argument("-p", "--play", action="store_true")
+args = parser.parse_args()
+
+name = args.name or os.path.splitext(os.path.basename(args.file))[0]
+size = os.path.getsize(args.file)
+chunk = args.chunk * 1024
+
+context = zmq.Context()
+socket = context.socket(zmq.REQ)
+socket.connect(f"tcp://{args.host}:{args.port}")
+
+def request(msg):
+  socket.send(msg if isinstance(msg, bytes) else msg.encode())
+  reply = socket.recv().decode()
+  if reply.startswith("FAIL"):
+    raise SystemExit(f"{msg[:40]!r}: {reply}")
+  return reply
+
+start = time.monotonic()
+request(f".upload {name} {size} {args.loop}")
+worst = 0
+with open(args.file, "rb") as f:
+  offset = 0
+  while offset < size:
+    data = f.read(chunk)
+    t = time.monotonic()
+    request(f".chunk {name} {offset}\n".encode() + data)
+    worst = max(worst, time.monotonic() - t)
+    offset += len(data)
+request(f".commit {name}")
+sent = time.monotonic() - start
+print(f"sent {size / 1e6:.1f} MB in {sent:.2f}s: {size / 1e6 / sent:.1f} MB/s, "
+      f"slowest {chunk // 1024} KiB chunk {worst * 1000:.1f} ms")
+
+while True:
+  status = request(f".uploaded {name}")
+  if status != "BUSY":
+    break
+  time.sleep(0.05)
+_, frames, compile_ms = status.split()
+print(f"compiled {frames} frames in {int(compile_ms) / 1000:.2f}s, "
+      f"{time.monotonic() - start:.2f}s from first chunk to playable")
+
+if args.play:
+  time.sleep(0.2) # indexed by the viewer's file watch
+  print(request(name))
@@ -0,0 +1,92 @@
+/*
+* Rotation speed adaptive refresh settings, see ./hologram-governor.h
+*/
+
+#include "hologram-governor.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#define GOVERNOR_BIT_PLANES 11 // rgb_matrix::internal::Framebuffer::kBitPlanes
+
+QualityGovernor::QualityGovernor(rgb_matrix::RGBMatrix *matrix)
+  : matrix_(matrix), current_(0), limit_hz_(-1),
+    sample_sum_(0), samples_(0), settle_(GOVERNOR_SETTLE), report_()
+{
+  // the configured pwm bits are the most slices are converted with, so the ceiling;
+  // dither bits only save time when they skip planes that are shown at all
+  for( int bits = 1; bits <= matrix->pwmbits(); bits++ )
+  {
+    for( int dither = 2; dither >= 0; dither-- )
+    {
+      if( dither > 0 && GOVERNOR_BIT_PLANES - bits >= dither ) continue;
+      levels_.push_back({ (uint8_t)bits, (uint8_t)dither, 0 });
+      if( bits == matrix->pwmbits() && dither == 0 ) current_ = levels_.size() - 1;
+    }
+  }
+}
+
+void QualityGovernor::Sample()
+{
+  if( settle_ > 0 )
+  {
+    settle_--;
+    return;
+  }
+  const uint32_t us = matrix_->LastDumpMicros();
+  if( us == 0 ) return;
+  sample_sum_ += us;
+  samples_++;
+}
+
+bool QualityGovernor::Update(uint32_t rotation_us)
+{
+  Level &level = levels_[current_];
+  if( samples_ > 0 )
+  {
+    const float us = (float)sample_sum_ / samples_;
+    level.dump_us = level.dump_us == 0 ? us : 0.75f * level.dump_us + 0.25f * us;
+    sample_sum_ = 0;
+    samples_ = 0;
+  }
+
+  const uint32_t slice_us = rotation_us / SLICE_COUNT;
+  if( slice_us == 0 || slice_us > GOVERNOR_MAX_SLICE_US || level.dump_us == 0 ) return false;
+
+  const float budget = slice_us * GOVERNOR_MARGIN;
+  const size_t previous = current_;
+  while( current_ > 0 && levels_[current_].dump_us > budget ) current_--;
+  if( current_ == previous && current_ + 1 < levels_.size() )
+  {
+    const Level &next = levels_[current_ + 1];
+    if( next.dump_us == 0 || next.dump_us < budget * GOVERNOR_HEADROOM ) current_++;
+  }
+
+  Apply(slice_us);
+  if( current_ == previous ) return false;
+  settle_ = GOVERNOR_SETTLE;
+  snprintf(report_, sizeof(report_), "%u pwm bits, %u dither bits, limit %dHz (slice %uus, refresh %.0fus)",
+           levels_[current_].pwm_bits, levels_[current_].dither_bits, limit_hz_,
+           slice_us, levels_[current_].dump_us);
+  return true;
+}
+
+void QualityGovernor::Apply(uint32_t slice_us)
+{
+  const Level &level = levels_[current_];
+  matrix_->SetPWMDitherBits(level.dither_bits);
+
+  // the same whole number of refreshes for every slice, unlimited while untested
+  int limit_hz = 0;
+  if( level.dump_us > 0 )
+  {
+    const int per_slice = std::max(1, (int)(slice_us * GOVERNOR_MARGIN / level.dump_us));
+    limit_hz = 1e6 * per_slice / slice_us;
+  }
+  if( limit_hz != limit_hz_ )
+  {
+    limit_hz_ = limit_hz;
+    matrix_->SetLimitRefreshRate(limit_hz);
+  }
+}
@@ -0,0 +1,73 @@
+/*
+* Picks pwm bits, pwm dither bits and the refresh limit for the current rotation speed
+*
+* Each slice faces the viewer for rotation period / SLICE_COUNT. A refresh has to fit
+* into that time or slices get skipped, and refresh time grows with every pwm bit.
+* The governor measures the refresh time of each setting it runs (DumpToMatrix, see
+* RGBMatrix::LastDumpMicros()) and at every frame boundary moves to the best setting
+* that still fits, trying untested settings one step at a time. The refresh limit is
+* set so each slice gets the same number of refreshes.
+*
+* Slices are converted at the configured pwm bits (--led-pwm-bits), which is also the
+* highest setting, the display canvases get pwm_bits() through SetPWMBits and show the
+* top planes of that conversion.
+*/
+
+#ifndef HOLOGRAM_GOVERNOR_H
+#define HOLOGRAM_GOVERNOR_H
+
+#include "anim-format.h"
+#include "led-matrix.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+#define GOVERNOR_MARGIN 0.85 // share of a slice a refresh may take
+#define GOVERNOR_HEADROOM 0.9 // step up only if the next setting fits this share of the margin
+#define GOVERNOR_SETTLE 4 // refreshes to ignore after a change
+#define GOVERNOR_MAX_SLICE_US 20000 // slower than this the motor is considered stopped
+
+class QualityGovernor
+{
+public:
+  // starts at, and never goes above, the matrix' current pwm bits
+  QualityGovernor(rgb_matrix::RGBMatrix *matrix);
+
+  // after every SwapOnVSync
+  void Sample();
+
+  // at a frame boundary, `rotation_us` is the measured rotation period;
+  // true when the setting changed, report() then describes it
+  bool Update(uint32_t rotation_us);
+
+  // the refresh limit was set elsewhere meanwhile, set it again at the next Update()
+  void Resume() { limit_hz_ = -1; }
+
+  uint8_t pwm_bits() const { return levels_[current_].pwm_bits; }
+
+  // the setting Update() changed to, for the caller to log off the display thread
+  const char *report() const { return report_; }
+
+private:
+  struct Level
+  {
+    uint8_t pwm_bits;
+    uint8_t dither_bits;
+    float dump_us; // measured refresh time, 0 until it ran
+  };
+
+  void Apply(uint32_t slice_us);
+
+  rgb_matrix::RGBMatrix *const matrix_;
+  std::vector<Level> levels_; // ascending quality and refresh time
+  size_t current_;
+  int limit_hz_;
+
+  uint64_t sample_sum_;
+  uint32_t samples_;
+  uint32_t settle_;
+  char report_[128];
+};
+
+#endif
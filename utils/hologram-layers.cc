@@ -0,0 +1,114 @@
+/*
+* Overlay layers, see ./hologram-layers.h
+*/
+
+#include "hologram-layers.h"
+
+#include <string.h>
+
+static inline bool Opaque(const Pixel &p)
+{
+  return (p.r | p.g | p.b) != 0;
+}
+
+LayerStack::LayerStack()
+  : overlay_(new SimpleFrame()), versions_(0), dirty_(false)
+{
+  for( size_t k = 0; k < SLICE_COUNT; k++ )
+  {
+    top_[k] = bottom_[k] = 0;
+    version_[k] = 0;
+  }
+}
+
+bool LayerStack::Add(const std::string &name, std::unique_ptr<Layer> layer)
+{
+  if( layers_.size() >= LAYER_MAX || Has(name) ) return false;
+  layers_.push_back({ name, std::move(layer), std::unique_ptr<SimpleFrame>(new SimpleFrame()) });
+  dirty_ = true;
+  return true;
+}
+
+bool LayerStack::Remove(const std::string &name)
+{
+  for( auto it = layers_.begin(); it != layers_.end(); ++it )
+  {
+    if( it->name != name ) continue;
+    layers_.erase(it);
+    dirty_ = true;
+    return true;
+  }
+  return false;
+}
+
+bool LayerStack::Has(const std::string &name) const
+{
+  for( const Entry &e : layers_ )
+    if( e.name == name ) return true;
+  return false;
+}
+
+Layer *LayerStack::Get(const std::string &name) const
+{
+  for( const Entry &e : layers_ )
+    if( e.name == name ) return e.layer.get();
+  return nullptr;
+}
+
+void LayerStack::Clear()
+{
+  if( layers_.empty() ) return;
+  layers_.clear();
+  dirty_ = true;
+}
+
+void LayerStack::Update(int64_t shown_ms)
+{
+  bool changed = dirty_;
+  for( Entry &e : layers_ )
+    changed |= e.layer->Render(e.content.get(), shown_ms);
+  if( changed ) Merge();
+  dirty_ = false;
+}
+
+void LayerStack::Merge()
+{
+  std::unique_ptr<Slice> merged(new Slice());
+  for( size_t k = 0; k < SLICE_COUNT; k++ )
+  {
+    *merged = Slice();
+    for( const Entry &e : layers_ )
+    {
+      const Pixel *src = e.content->slices[k].pixels;
+      for( size_t p = 0; p < SLICE_ROWS * SLICE_COLS; p++ )
+        if( Opaque(src[p]) ) merged->pixels[p] = src[p];
+    }
+
+    Slice &overlay = overlay_->slices[k];
+    if( memcmp(merged->pixels, overlay.pixels, sizeof(overlay.pixels)) == 0 ) continue;
+    memcpy(overlay.pixels, merged->pixels, sizeof(overlay.pixels));
+    version_[k] = ++versions_;
+
+    // rows Compose() has to look at
+    top_[k] = SLICE_ROWS;
+    bottom_[k] = 0;
+    for( uint16_t y = 0; y < SLICE_ROWS; y++ )
+    {
+      for( size_t x = 0; x < SLICE_COLS; x++ )
+      {
+        if( !Opaque(overlay.pixels[y * SLICE_COLS + x]) ) continue;
+        if( y < top_[k] ) top_[k] = y;
+        bottom_[k] = y + 1;
+        break;
+      }
+    }
+  }
+}
+
+void LayerStack::Compose(size_t k, Slice *base) const
+{
+  const Pixel *src = overlay_->slices[k].pixels;
+  Pixel *dst = base->pixels;
+  for( size_t p = top_[k] * SLICE_COLS; p < (size_t)bottom_[k] * SLICE_COLS; p++ )
+    if( Opaque(src[p]) ) dst[p] = src[p];
+}
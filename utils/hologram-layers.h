@@ -0,0 +1,80 @@
+/*
+* Overlay layers in front of the playing anim (status text, a clock, a progress ring)
+*
+* Each layer renders a whole SimpleFrame per anim frame, black pixels are transparent
+* and later layers cover earlier ones. LayerStack merges them into one overlay and
+* tracks per slice whether the overlay has content and when it last changed, so the
+* viewer only composites and converts slices the overlay touches and can keep
+* composited slices while neither the anim slice nor the overlay slice changed.
+*
+* Layers run on the producer thread, one Render() per produced frame.
+*/
+
+#ifndef HOLOGRAM_LAYERS_H
+#define HOLOGRAM_LAYERS_H
+
+#include "anim-format.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#define LAYER_MAX 4 // layers in front of the anim
+
+class Layer
+{
+public:
+  virtual ~Layer() {}
+
+  // render the next frame, shown at `shown_ms` (ms since the epoch), into `out`;
+  // false if it didn't change, `out` then still holds the last content
+  virtual bool Render(SimpleFrame *out, int64_t shown_ms) = 0;
+};
+
+class LayerStack
+{
+public:
+  LayerStack();
+
+  // on top of the others; false if LAYER_MAX layers are shown or `name` already is
+  bool Add(const std::string &name, std::unique_ptr<Layer> layer);
+  bool Remove(const std::string &name);
+  bool Has(const std::string &name) const;
+  Layer *Get(const std::string &name) const; // nullptr if not shown
+  void Clear();
+  bool empty() const { return layers_.empty(); }
+
+  // advance all layers to the frame shown at `shown_ms` and merge what changed
+  void Update(int64_t shown_ms);
+
+  // overlay has content in slice `k`
+  bool Covers(size_t k) const { return top_[k] < bottom_[k]; }
+
+  // changes whenever the overlay of slice `k` does, never repeats
+  uint32_t version(size_t k) const { return version_[k]; }
+
+  // draw the overlay of slice `k` over `base`
+  void Compose(size_t k, Slice *base) const;
+
+private:
+  struct Entry
+  {
+    std::string name;
+    std::unique_ptr<Layer> layer;
+    std::unique_ptr<SimpleFrame> content;
+  };
+
+  void Merge();
+
+  std::vector<Entry> layers_; // bottom to top
+  std::unique_ptr<SimpleFrame> overlay_;
+  uint16_t top_[SLICE_COUNT]; // rows of the overlay with content, per slice
+  uint16_t bottom_[SLICE_COUNT];
+  uint32_t version_[SLICE_COUNT];
+  uint32_t versions_;
+  bool dirty_; // layers were added or removed
+};
+
+#endif
@@ -0,0 +1,160 @@
+/*
+* Rotation tracking, see ./hologram-rotation.h
+*/
+
+#include "hologram-rotation.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SPIN_LOG_BUFFER (1 << 16)
+
+static int compare_ints(const void *a, const void *b) {
+  return *((int*)a) - *((int*)b);
+}
+
+RotationEstimator::RotationEstimator()
+  : sync_prev_(0), angle_(0), delta_(256), level_(1), tick_prev_(0), current_(0),
+    zero_(ROTATION_FULL / 360 * ROTATION_ZERO), period_raw_(0), period_(1<<26), drift_(0)
+{
+  memset(history_, 0, sizeof(history_));
+}
+
+uint32_t RotationEstimator::MedianPeriod() const {
+  uint32_t sorted[ROTATION_HISTORY];
+  memcpy(sorted, history_, sizeof(sorted));
+  qsort(sorted, ROTATION_HISTORY, sizeof(*sorted), compare_ints);
+
+  return (sorted[ROTATION_HISTORY / 2 - 1] + sorted[ROTATION_HISTORY / 2])/2;
+}
+
+uint32_t RotationEstimator::Update(uint32_t tick_curr, int sync) {
+  uint32_t elapsed = tick_curr - sync_prev_;
+
+  if (sync != level_) {
+    level_ = sync;
+
+    if(sync == 0) {
+      sync_prev_ = tick_curr;
+      period_raw_ = elapsed;
+      if (elapsed > ROTATION_MIN_PERIOD) {
+        if (++current_ >= ROTATION_HISTORY) {
+            current_ = 0;
+        }
+        history_[current_] = elapsed;
+        period_ = MedianPeriod();
+
+        // median is 0 until half the history is filled (ARM divides that to 0, x86 traps)
+        delta_ = period_ ? ROTATION_FULL / period_ : 0;
+      }
+    }
+  }
+
+  uint32_t dtick = (tick_curr - tick_prev_);
+  tick_prev_ = tick_curr;
+
+  uint32_t delta = dtick * delta_;
+
+  angle_ = (angle_ + delta) & ROTATION_MASK;
+
+  zero_ = (zero_ + ROTATION_FULL + (dtick * drift_)) & ROTATION_MASK;
+
+  return (angle_ + zero_) & ROTATION_MASK;
+}
+
+MotorMonitor::MotorMonitor()
+  : state_(MOTOR_STOPPED), level_(1), edged_(false), edge_us_(0), count_(0), next_(0)
+{
+  memset(periods_, 0, sizeof(periods_));
+}
+
+const char *MotorMonitor::Name(MotorState state)
+{
+  switch( state )
+  {
+    case MOTOR_STOPPED: return "stopped";
+    case MOTOR_SPIN_UP: return "spin-up";
+    case MOTOR_LOCKED: return "locked";
+    case MOTOR_LOST: return "lost sync";
+  }
+  return "?";
+}
+
+bool MotorMonitor::Steady() const
+{
+  if( count_ < MOTOR_LOCK_TURNS ) return false;
+  uint32_t shortest = periods_[0], longest = periods_[0];
+  for( uint32_t p : periods_ )
+  {
+    if( p < shortest ) shortest = p;
+    if( p > longest ) longest = p;
+  }
+  return longest - shortest <= longest * MOTOR_LOCK_JITTER;
+}
+
+MotorState MotorMonitor::Update(uint32_t now_us, int level)
+{
+  const uint32_t since = now_us - edge_us_;
+  const bool falling = level != level_ && level == 0;
+  level_ = level;
+
+  if( falling && (!edged_ || since > ROTATION_MIN_PERIOD) )
+  {
+    if( edged_ && since <= MOTOR_STOP_US )
+    {
+      periods_[next_] = since;
+      next_ = (next_ + 1) % MOTOR_LOCK_TURNS;
+      if( count_ < MOTOR_LOCK_TURNS ) count_++;
+    }
+    edged_ = true;
+    edge_us_ = now_us;
+
+    // a turn out of line with the last ones loses a lock, doesn't end it
+    if( Steady() ) state_ = MOTOR_LOCKED;
+    else if( state_ == MOTOR_LOCKED || state_ == MOTOR_LOST ) state_ = MOTOR_LOST;
+    else state_ = MOTOR_SPIN_UP;
+    return state_;
+  }
+
+  if( !edged_ || since > MOTOR_STOP_US )
+  {
+    state_ = MOTOR_STOPPED;
+    count_ = 0;
+  }
+  else if( state_ == MOTOR_LOCKED && count_ > 0 )
+  {
+    const uint32_t last = periods_[(next_ + MOTOR_LOCK_TURNS - 1) % MOTOR_LOCK_TURNS];
+    if( since > MOTOR_LOST_TURNS * last ) state_ = MOTOR_LOST;
+  }
+  return state_;
+}
+
+SpinRecorder::SpinRecorder() : f_(NULL), last_us_(0), level_(-1) {}
+
+SpinRecorder::~SpinRecorder()
+{
+  if( f_ ) fclose(f_);
+}
+
+bool SpinRecorder::Open(const char *path)
+{
+  f_ = fopen(path, "wb");
+  if( !f_ )
+  {
+    perror(path);
+    return false;
+  }
+  // edges are rare, a large buffer keeps writes out of the display loop
+  setvbuf(f_, NULL, _IOFBF, SPIN_LOG_BUFFER);
+  fwrite(SPIN_LOG_MAGIC, 1, 8, f_);
+  return true;
+}
+
+void SpinRecorder::Sample(uint32_t now_us, int level)
+{
+  if( !f_ || level == level_ ) return;
+  const uint32_t record = level_ < 0 ? (uint32_t)level : ((now_us - last_us_) << 1) | (level & 1);
+  fwrite(&record, sizeof(record), 1, f_);
+  last_us_ = now_us;
+  level_ = level;
+}
@@ -0,0 +1,116 @@
+/*
+* Rotation tracking from the SPIN_SYNC gpio, one pulse per turn
+*
+* RotationEstimator takes the sync level each time the display loop picks a slice.
+* Falling edges give rotation periods, the median of the last ROTATION_HISTORY sets
+* the angular speed, and the angle is integrated from it in fixed point
+* (ROTATION_FULL per turn).
+*
+* MotorMonitor tells from the same samples whether the motor is stopped, spinning
+* up, turning steadily enough to show slices (locked), or lost the sync pulses it
+* was locked to. The viewer blanks the panel and pauses while it isn't turning
+* (see: hologram-viewer -m).
+*
+* SpinRecorder writes every level change to a compact log that ./spin-replay feeds
+* back through RotationEstimator offline, to compare estimator changes against
+* recordings from real motors.
+*
+* Log: SPIN_LOG_MAGIC, then one uint32_t per level change:
+*      (microseconds since the previous change << 1) | new level
+*/
+
+#ifndef HOLOGRAM_ROTATION_H
+#define HOLOGRAM_ROTATION_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ROTATION_PRECISION 30
+#define ROTATION_FULL (1<<ROTATION_PRECISION)
+#define ROTATION_ZERO 286 // degrees from the sync edge to slice 0
+#define ROTATION_HISTORY 8
+#define ROTATION_HALF (1<<(ROTATION_PRECISION-1))
+#define ROTATION_MASK ((1<<ROTATION_PRECISION)-1)
+#define ROTATION_MIN_PERIOD 10000 // us, shorter pulses are bounce
+
+#define MOTOR_STOP_US 500000 // no turn for this long: stopped
+#define MOTOR_LOCK_TURNS 4 // consecutive periods that have to agree to lock
+#define MOTOR_LOCK_JITTER 0.05 // how far they may spread, share of the longest
+#define MOTOR_LOST_TURNS 2 // locked, but no edge for this many periods: lost
+
+#define SPIN_LOG_MAGIC "HOLOSPIN"
+
+enum MotorState { MOTOR_STOPPED, MOTOR_SPIN_UP, MOTOR_LOCKED, MOTOR_LOST };
+
+class RotationEstimator
+{
+public:
+  RotationEstimator();
+
+  // `level` of SPIN_SYNC at `now_us` (GetMicrosecondCounter()), returns the angle
+  uint32_t Update(uint32_t now_us, int level);
+
+  uint32_t period() const { return period_; } // median rotation period in us
+  uint32_t period_raw() const { return period_raw_; } // last measured period
+  uint32_t zero() const { return zero_; } // angle offset added to the integrated angle
+
+  // angle covered in `us` at the current speed
+  uint32_t Lead(uint32_t us) const { return (us * (uint32_t)delta_) & ROTATION_MASK; }
+
+private:
+  uint32_t MedianPeriod() const;
+
+  uint32_t sync_prev_; // time of the last falling edge
+  uint32_t angle_;
+  int32_t delta_; // angle per us
+  int level_;
+  uint32_t tick_prev_;
+  uint32_t history_[ROTATION_HISTORY];
+  uint32_t current_;
+  uint32_t zero_;
+  uint32_t period_raw_;
+  uint32_t period_;
+  int32_t drift_;
+};
+
+class MotorMonitor
+{
+public:
+  MotorMonitor();
+
+  // the samples RotationEstimator::Update() gets, returns the state after this one
+  MotorState Update(uint32_t now_us, int level);
+
+  MotorState state() const { return state_; }
+  static const char *Name(MotorState state);
+
+private:
+  bool Steady() const;
+
+  MotorState state_;
+  int level_;
+  bool edged_; // edge_us_ is valid
+  uint32_t edge_us_; // last falling edge
+  uint32_t periods_[MOTOR_LOCK_TURNS]; // the last ones, ring
+  uint32_t count_; // consecutive periods measured, up to MOTOR_LOCK_TURNS
+  uint32_t next_;
+};
+
+class SpinRecorder
+{
+public:
+  SpinRecorder();
+  ~SpinRecorder();
+
+  bool Open(const char *path);
+
+  // call with every sample, only level changes are written
+  void Sample(uint32_t now_us, int level);
+
+private:
+  FILE *f_;
+  uint32_t last_us_;
+  int level_;
+};
+
+#endif
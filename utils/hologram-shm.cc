@@ -0,0 +1,72 @@
+/*
+* Shared memory volume ring, see ./hologram-shm.h
+*/
+
+#include "hologram-shm.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static_assert(sizeof(SimpleFrame) == HOLO_SHM_FRAME_SIZE, "holo-shm.h layout differs from SimpleFrame");
+static_assert(HOLO_SHM_SLICES == SLICE_COUNT && HOLO_SHM_ROWS == SLICE_ROWS && HOLO_SHM_COLS == SLICE_COLS,
+              "holo-shm.h size differs from anim-format.h");
+
+VolumeRing::VolumeRing() : ring_(NULL), name_(NULL) {}
+
+VolumeRing::~VolumeRing()
+{
+  if( !ring_ ) return;
+  holo_shm_close(ring_);
+  shm_unlink(name_); // may fail once privileges dropped, the next Create() replaces it
+}
+
+bool VolumeRing::Create(const char *name)
+{
+  ring_ = holo_shm_create(name);
+  if( !ring_ )
+  {
+    fprintf(stderr, "Can't create shared memory %s: %s\n", name, strerror(errno));
+    return false;
+  }
+  name_ = name;
+  return true;
+}
+
+const holo_shm_slot *VolumeRing::SlotOf(const SimpleFrame *frame) const
+{
+  return (const holo_shm_slot*)((const uint8_t*)frame - offsetof(holo_shm_slot, pixels));
+}
+
+const SimpleFrame *VolumeRing::Latest(uint32_t *seq, uint32_t *head) const
+{
+  // before the first publish this is a blank slot
+  *head = this->head();
+  const holo_shm_slot *slot = &ring_->slot[(*head + HOLO_SHM_SLOTS - 1) % HOLO_SHM_SLOTS];
+  *seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+  if( *seq & 1 ) return NULL;
+  return (const SimpleFrame*)slot->pixels;
+}
+
+bool VolumeRing::Intact(const SimpleFrame *frame, uint32_t seq) const
+{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE); // pixel reads before the second seq read
+  return __atomic_load_n(&SlotOf(frame)->seq, __ATOMIC_RELAXED) == seq;
+}
+
+void VolumeRing::Wait(uint32_t seen, int timeout_ms) const
+{
+  struct timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+  syscall(SYS_futex, &ring_->wake, FUTEX_WAIT, seen, &timeout, NULL, 0);
+}
+
+void VolumeRing::Wake()
+{
+  __atomic_add_fetch(&ring_->wake, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &ring_->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
@@ -0,0 +1,55 @@
+/*
+* Reading side of the shared memory volume ring (see: ./holo-shm.h)
+*
+* hologram-viewer -M creates the ring before dropping privileges. While the anim
+* HOLO_SHM_ANIM plays, the producer converts the newest published slot straight
+* out of shared memory and checks the slot's seqlock afterwards; a frame the
+* writer lapped during conversion is dropped and the newer one converted instead.
+*
+* The producer sleeps on the ring's futex word, which both writers and the
+* viewer's own wake-ups (freed queue slots, commands) bump.
+*/
+
+#ifndef HOLOGRAM_SHM_H
+#define HOLOGRAM_SHM_H
+
+#include "anim-format.h"
+#include "holo-shm.h"
+
+#include <stdint.h>
+
+#define SHM_POLL_MS 5 // longest producer sleep, for writers that don't wake the futex
+
+class VolumeRing
+{
+public:
+  VolumeRing();
+  ~VolumeRing();
+
+  // false with a message on stderr if the ring can't be set up
+  bool Create(const char *name);
+
+  uint32_t head() const { return __atomic_load_n(&ring_->head, __ATOMIC_ACQUIRE); }
+  uint32_t wake() const { return __atomic_load_n(&ring_->wake, __ATOMIC_ACQUIRE); }
+
+  // newest frame, its slot sequence and the head() it was found by, NULL while the
+  // writer is in that slot
+  const SimpleFrame *Latest(uint32_t *seq, uint32_t *head) const;
+
+  // true if the slot read from Latest() wasn't written meanwhile
+  bool Intact(const SimpleFrame *frame, uint32_t seq) const;
+
+  // sleep until wake() differs from `seen` or `timeout_ms` passed
+  void Wait(uint32_t seen, int timeout_ms) const;
+
+  // bump wake() and wake a Wait()
+  void Wake();
+
+private:
+  const holo_shm_slot *SlotOf(const SimpleFrame *frame) const;
+
+  holo_shm_ring *ring_;
+  const char *name_;
+};
+
+#endif
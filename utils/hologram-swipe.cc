@@ -0,0 +1,123 @@
+/*
+* Swipe sensor input, see ./hologram-swipe.h
+*/
+
+#include "hologram-swipe.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t MonotonicMicros()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+SwipeDetector::SwipeDetector() : armed_(0) {}
+
+char SwipeDetector::Edge(char sensor)
+{
+  if( sensor != 'L' && sensor != 'R' ) return 0;
+  if( armed_ == sensor ) return sensor;
+  armed_ = sensor;
+  return 0;
+}
+
+SwipeInput::SwipeInput() : fd_(-1), fake_(false) {}
+
+SwipeInput::~SwipeInput()
+{
+  Close();
+}
+
+void SwipeInput::Close()
+{
+  if( fd_ >= 0 ) close(fd_);
+  fd_ = -1;
+}
+
+bool SwipeInput::Open(const char *device)
+{
+  // read-write, so the fifo never reads as hung up between writers
+  const int chip = open(device, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if( chip < 0 )
+  {
+    fprintf(stderr, "%s: %s\n", device, strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if( fstat(chip, &st) == 0 && S_ISFIFO(st.st_mode) )
+  {
+    fd_ = chip;
+    fake_ = true;
+    return true;
+  }
+
+  struct gpio_v2_line_request request;
+  memset(&request, 0, sizeof(request));
+  request.offsets[0] = SWIPE_RIGHT_LINE;
+  request.offsets[1] = SWIPE_LEFT_LINE;
+  request.num_lines = 2;
+  strncpy(request.consumer, "hologram-swipe", sizeof(request.consumer) - 1);
+  request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING;
+  // the kernel filters bounce before it wakes us; the script got that from polling at 100Hz
+  request.config.num_attrs = 1;
+  request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+  request.config.attrs[0].attr.debounce_period_us = SWIPE_DEBOUNCE_US;
+  request.config.attrs[0].mask = 0b11;
+  if( ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &request) < 0 )
+  {
+    fprintf(stderr, "%s lines %d, %d: %s\n", device, SWIPE_RIGHT_LINE, SWIPE_LEFT_LINE, strerror(errno));
+    close(chip);
+    return false;
+  }
+  close(chip); // the line request holds its own reference
+  fd_ = request.fd;
+  fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+bool SwipeInput::Read(const std::function<void(char direction, uint64_t edge_us)> &swipe)
+{
+  if( fd_ < 0 ) return false;
+  for( ;; )
+  {
+    struct gpio_v2_line_event events[16];
+    char bytes[64];
+    const ssize_t n = fake_ ? read(fd_, bytes, sizeof(bytes)) : read(fd_, events, sizeof(events));
+    if( n < 0 && errno == EINTR ) continue;
+    if( n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) break;
+    if( n <= 0 )
+    {
+      fprintf(stderr, "Swipe read: %s\n", n == 0 ? "closed" : strerror(errno));
+      return false;
+    }
+
+    if( fake_ )
+    {
+      const uint64_t now = MonotonicMicros();
+      for( ssize_t i = 0; i < n; i++ )
+      {
+        const char d = detector_.Edge(bytes[i]);
+        if( d ) swipe(d, now);
+      }
+      continue;
+    }
+    for( size_t i = 0; i < n / sizeof(events[0]); i++ )
+    {
+      if( events[i].id != GPIO_V2_LINE_EVENT_RISING_EDGE ) continue;
+      const uint64_t edge_us = events[i].timestamp_ns / 1000;
+      const char d = detector_.Edge(events[i].offset == SWIPE_RIGHT_LINE ? 'R' : 'L');
+      if( d ) swipe(d, edge_us);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,68 @@
+/*
+* Swipe sensor input for hologram-viewer, replacing the gpio polling of ./holo-autocontrol.py
+*
+* Two touch sensors, SWIPE_RIGHT_LINE and SWIPE_LEFT_LINE of a gpiochip, requested
+* through the gpio character device with rising edge events, debounced by the
+* kernel. The viewer waits on the line fd with its other control inputs, so a swipe
+* wakes it at once, and edges carry kernel timestamps to tell how long after the
+* touch the rotation changed. Like the script, an edge on a sensor arms it and every
+* further edge on the same sensor, with no edge on the other one in between, is a
+* swipe that way.
+*
+* Instead of a gpiochip, a fifo works as a fake line source. Each 'R' or 'L' byte
+* written to it is a rising edge of that sensor, stamped when it's read:
+*   $ mkfifo /tmp/holo-swipe
+*   $ hologram-viewer ... -G /tmp/holo-swipe
+*   $ printf LRR > /tmp/holo-swipe
+*/
+
+#ifndef HOLOGRAM_SWIPE_H
+#define HOLOGRAM_SWIPE_H
+
+#include <stdint.h>
+
+#include <functional>
+
+#define SWIPE_CHIP "/dev/gpiochip4"
+#define SWIPE_RIGHT_LINE 6
+#define SWIPE_LEFT_LINE 13
+#define SWIPE_DEBOUNCE_US 10000 // the kernel drops edges of a sensor closer than this
+
+// turns sensor edges into swipes
+class SwipeDetector
+{
+public:
+  SwipeDetector();
+
+  // rising edge of sensor 'L' or 'R'; the swipe it completes, 'L' or 'R', else 0
+  char Edge(char sensor);
+
+private:
+  char armed_; // sensor of the last edge
+};
+
+class SwipeInput
+{
+public:
+  SwipeInput();
+  ~SwipeInput();
+
+  // false with a message on stderr if `device`, a gpiochip or a fifo, can't be set up
+  bool Open(const char *device);
+
+  int fd() const { return fd_; }
+
+  // read the edges available once fd() polled readable and call `swipe` with the
+  // direction and CLOCK_MONOTONIC time in us of each completed swipe; false on errors,
+  // fd() is left open for the caller to take out of its poll before Close()
+  bool Read(const std::function<void(char direction, uint64_t edge_us)> &swipe);
+
+  void Close();
+
+private:
+  int fd_;
+  bool fake_; // fifo of 'L'/'R' bytes
+  SwipeDetector detector_;
+};
+
+#endif
@@ -0,0 +1,243 @@
+/*
+* Frame clock and rotation phase synchronization, see ./hologram-sync.h
+*/
+
+#include "hologram-sync.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+
+#define SYNC_MAGIC 0x484F5359 // "HOSY"
+
+// offset ping, sent by followers and stamped by the leader
+struct SyncPing
+{
+  uint64_t t0; // follower send time
+  uint64_t t1; // leader receive time
+};
+
+uint64_t SyncClockMicros()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int32_t AnimFrameDistance(uint32_t from, uint32_t to, uint32_t frameCount, uint32_t loopStart)
+{
+  if( frameCount == 0 || from >= frameCount || to >= frameCount ) return -1;
+  if( loopStart >= frameCount ) loopStart = frameCount - 1;
+  if( to >= from ) return to - from;
+  if( to < loopStart ) return -1; // only reachable before the loop
+  return (frameCount - from) + (to - loopStart);
+}
+
+uint32_t AnimFrameAfter(uint32_t from, uint32_t steps, uint32_t frameCount, uint32_t loopStart)
+{
+  if( frameCount == 0 ) return 0;
+  if( loopStart >= frameCount ) loopStart = frameCount - 1;
+  uint64_t to = (uint64_t)from + steps;
+  if( to < frameCount ) return to;
+  return loopStart + (to - loopStart) % (frameCount - loopStart);
+}
+
+HoloSync::HoloSync(Role role, const std::string &host, int port,
+                   std::function<uint64_t()> clock)
+  : role_(role), host_(host), port_(port), clock_(clock), context_(1),
+    running_(false), state_version_(0), offset_us_(0), rtt_us_(0), have_offset_(false)
+{
+}
+
+HoloSync::~HoloSync()
+{
+  Stop();
+}
+
+void HoloSync::Start()
+{
+  running_ = true;
+  if( role_ == SYNC_LEADER )
+    thread_ = std::thread(&HoloSync::RunLeader, this);
+  else
+    thread_ = std::thread(&HoloSync::RunFollower, this);
+}
+
+void HoloSync::Stop()
+{
+  running_ = false;
+  if( thread_.joinable() ) thread_.join();
+}
+
+void HoloSync::Publish(const SyncState &state)
+{
+  std::lock_guard<std::mutex> l(state_mutex_);
+  state_ = state;
+  state_.magic = SYNC_MAGIC;
+  if( state_.tick_us == 0 ) state_.tick_us = clock_();
+  state_dirty_ = true;
+  have_state_ = true;
+  state_version_++;
+}
+
+bool HoloSync::Expected(uint64_t now_us, SyncTarget *target)
+{
+  if( !have_offset_ ) return false;
+
+  // the leader state changes about once a frame, called far more often
+  if( state_version_.load() == 0 ) return false;
+  if( state_version_.load() != expected_version_ )
+  {
+    std::lock_guard<std::mutex> l(state_mutex_);
+    expected_state_ = state_;
+    expected_version_ = state_version_.load();
+  }
+  const SyncState &s = expected_state_;
+  if( s.frame_time_ms == 0 ) return false;
+
+  // leader time now, and the leader ticks elapsed since its last publish
+  const int64_t leader_now = (int64_t)now_us + offset_us_.load();
+  const int64_t frame_us = (int64_t)s.frame_time_ms * 1000;
+  int64_t ticks = (leader_now - (int64_t)s.tick_us) / frame_us;
+  if( ticks < 0 ) ticks = 0;
+
+  target->clock = s.clock + ticks;
+  target->tick_local_us = s.tick_us + ticks * frame_us - offset_us_.load();
+  target->index = AnimFrameAfter(s.index, ticks, s.frameCount, s.loopStart);
+  target->frameCount = s.frameCount;
+  target->loopStart = s.loopStart;
+  target->phase = s.phase;
+  memcpy(target->anim, s.anim, sizeof(target->anim));
+  return true;
+}
+
+void HoloSync::RunLeader()
+{
+  zmq::socket_t pub(context_, zmq::socket_type::pub);
+  zmq::socket_t ping(context_, zmq::socket_type::rep);
+  pub.set(zmq::sockopt::linger, 0);
+  ping.set(zmq::sockopt::linger, 0);
+  pub.bind("tcp://" + host_ + ":" + std::to_string(port_));
+  ping.bind("tcp://" + host_ + ":" + std::to_string(port_ + 1));
+
+  uint64_t last_publish = 0;
+  zmq::pollitem_t items[] = { { ping.handle(), 0, ZMQ_POLLIN, 0 } };
+
+  while( running_ )
+  {
+    zmq::poll(items, 1, std::chrono::milliseconds(10));
+
+    if( items[0].revents & ZMQ_POLLIN )
+    {
+      zmq::message_t request;
+      if( ping.recv(request, zmq::recv_flags::dontwait) )
+      {
+        SyncPing p = {};
+        if( request.size() == sizeof(p) )
+          memcpy(&p, request.data(), sizeof(p));
+        p.t1 = clock_();
+        ping.send(zmq::buffer(&p, sizeof(p)), zmq::send_flags::none);
+      }
+    }
+
+    SyncState s;
+    {
+      std::lock_guard<std::mutex> l(state_mutex_);
+      const uint64_t now = clock_();
+      if( !have_state_ ) continue;
+      if( !state_dirty_ && now - last_publish < SYNC_HEARTBEAT * 1000 ) continue;
+      state_dirty_ = false;
+      last_publish = now;
+      s = state_;
+    }
+    pub.send(zmq::buffer(&s, sizeof(s)), zmq::send_flags::dontwait);
+  }
+}
+
+void HoloSync::AddPingSample(uint64_t t0, uint64_t t1, uint64_t t2)
+{
+  const size_t slot = samples_++ % SYNC_PING_SAMPLES;
+  sample_rtt_[slot] = t2 - t0;
+  sample_offset_[slot] = (int64_t)t1 - (int64_t)(t0 + (t2 - t0) / 2);
+
+  // the sample with the shortest round trip has the least queuing asymmetry
+  const size_t n = samples_ < SYNC_PING_SAMPLES ? samples_ : SYNC_PING_SAMPLES;
+  size_t best = 0;
+  for( size_t k = 1; k < n; k++ )
+  {
+    if( sample_rtt_[k] < sample_rtt_[best] ) best = k;
+  }
+  offset_us_ = sample_offset_[best];
+  rtt_us_ = sample_rtt_[best];
+  have_offset_ = true;
+}
+
+void HoloSync::RunFollower()
+{
+  zmq::socket_t sub(context_, zmq::socket_type::sub);
+  sub.set(zmq::sockopt::linger, 0);
+  sub.set(zmq::sockopt::subscribe, "");
+  sub.connect("tcp://" + host_ + ":" + std::to_string(port_));
+
+  const std::string ping_endpoint = "tcp://" + host_ + ":" + std::to_string(port_ + 1);
+  zmq::socket_t ping(context_, zmq::socket_type::req);
+  ping.set(zmq::sockopt::linger, 0);
+  ping.connect(ping_endpoint);
+
+  uint64_t ping_sent = 0; // 0 = no ping in flight
+  uint64_t last_ping = 0;
+
+  while( running_ )
+  {
+    zmq::pollitem_t items[] = {
+      { sub.handle(), 0, ZMQ_POLLIN, 0 },
+      { ping.handle(), 0, ZMQ_POLLIN, 0 },
+    };
+    zmq::poll(items, 2, std::chrono::milliseconds(10));
+
+    zmq::message_t msg;
+    while( sub.recv(msg, zmq::recv_flags::dontwait) )
+    {
+      SyncState s;
+      if( msg.size() != sizeof(s) ) continue;
+      memcpy(&s, msg.data(), sizeof(s));
+      if( s.magic != SYNC_MAGIC ) continue;
+      s.anim[sizeof(s.anim) - 1] = 0;
+
+      std::lock_guard<std::mutex> l(state_mutex_);
+      state_ = s;
+      have_state_ = true;
+      state_version_++;
+    }
+
+    const uint64_t now = clock_();
+    if( ping_sent != 0 && (items[1].revents & ZMQ_POLLIN) )
+    {
+      if( ping.recv(msg, zmq::recv_flags::dontwait) && msg.size() == sizeof(SyncPing) )
+      {
+        SyncPing p;
+        memcpy(&p, msg.data(), sizeof(p));
+        if( p.t0 == ping_sent ) AddPingSample(p.t0, p.t1, now);
+      }
+      ping_sent = 0;
+    }
+    else if( ping_sent != 0 && now - ping_sent > 4 * SYNC_PING_INTERVAL * 1000 )
+    {
+      // lost reply: a REQ socket can't send again, start over
+      ping.close();
+      ping = zmq::socket_t(context_, zmq::socket_type::req);
+      ping.set(zmq::sockopt::linger, 0);
+      ping.connect(ping_endpoint);
+      ping_sent = 0;
+    }
+
+    if( ping_sent == 0 && now - last_ping > SYNC_PING_INTERVAL * 1000 )
+    {
+      SyncPing p = { clock_(), 0 };
+      ping_sent = last_ping = p.t0;
+      ping.send(zmq::buffer(&p, sizeof(p)), zmq::send_flags::dontwait);
+    }
+  }
+}
@@ -0,0 +1,125 @@
+/*
+* Frame clock and rotation phase synchronization between several hologram-viewers
+*
+* The leader publishes its frame clock (frame advances, anim position) and rotation
+* phase over zeromq PUB. Followers estimate the leader's clock offset with periodic
+* REQ/REP pings (NTP style, minimum round trip of the recent samples wins) and use
+* it to advance frames on the leader's ticks.
+*
+* see: ./holo-sync-sim.cc for a loopback simulation of several units
+*/
+
+#ifndef HOLOGRAM_SYNC_H
+#define HOLOGRAM_SYNC_H
+
+#include <zmq.hpp>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define SYNC_PORT 5556 // leader PUB, frame clock
+#define SYNC_PING_PORT 5557 // leader REP, clock offset pings
+#define SYNC_PING_INTERVAL 500 // ms between offset pings
+#define SYNC_PING_SAMPLES 8 // offset samples to pick the best round trip from
+#define SYNC_HEARTBEAT 200 // ms between leader publishes without a frame change
+
+// microseconds on CLOCK_MONOTONIC
+uint64_t SyncClockMicros();
+
+// steps to go from anim frame `from` to `to`, following the loop; -1 if unreachable
+int32_t AnimFrameDistance(uint32_t from, uint32_t to, uint32_t frameCount, uint32_t loopStart);
+
+// anim frame reached after `steps` advances from `from`
+uint32_t AnimFrameAfter(uint32_t from, uint32_t steps, uint32_t frameCount, uint32_t loopStart);
+
+// published by the leader on every frame advance
+struct SyncState
+{
+  uint32_t magic = 0;
+  uint32_t clock = 0; // frame advances since leader start
+  uint64_t tick_us = 0; // leader time when `clock` was reached
+  uint32_t frame_time_ms = 0;
+  uint32_t index = 0; // anim frame shown at `clock`
+  uint32_t frameCount = 0;
+  uint32_t loopStart = 0;
+  int32_t phase = 0; // rotation offset in slices
+  char anim[64] = {0};
+};
+
+// where a follower should be at a given local time
+struct SyncTarget
+{
+  uint32_t clock = 0; // leader frame clock
+  uint64_t tick_local_us = 0; // local time the leader reached `clock`
+  uint32_t index = 0; // anim frame for `clock`
+  uint32_t frameCount = 0;
+  uint32_t loopStart = 0;
+  int32_t phase = 0;
+  char anim[64] = {0}; // as SyncState::anim, no allocation on the display thread
+};
+
+class HoloSync
+{
+public:
+  enum Role { SYNC_LEADER, SYNC_FOLLOWER };
+
+  // `host` is the leader address for followers, the bind address for the leader.
+  // `clock` returns local microseconds; the simulation passes skewed clocks.
+  HoloSync(Role role, const std::string &host, int port = SYNC_PORT,
+           std::function<uint64_t()> clock = SyncClockMicros);
+  ~HoloSync();
+
+  void Start();
+  void Stop();
+
+  Role role() const { return role_; }
+  uint64_t Now() const { return clock_(); }
+
+  // leader: frame advanced (state.tick_us is filled in when 0)
+  void Publish(const SyncState &state);
+
+  // follower: leader position at local time `now_us`;
+  // false until leader state and a clock offset are known.
+  // one caller thread only, it locks only to copy a new leader state
+  bool Expected(uint64_t now_us, SyncTarget *target);
+
+  // follower: estimated leader clock minus local clock, and its round trip
+  int64_t offset_us() const { return offset_us_.load(); }
+  uint32_t rtt_us() const { return rtt_us_.load(); }
+
+private:
+  void RunLeader();
+  void RunFollower();
+  void AddPingSample(uint64_t t0, uint64_t t1, uint64_t t2);
+
+  const Role role_;
+  const std::string host_;
+  const int port_;
+  const std::function<uint64_t()> clock_;
+
+  zmq::context_t context_;
+  std::thread thread_;
+  std::atomic<bool> running_;
+
+  std::mutex state_mutex_;
+  SyncState state_; // leader: to publish, follower: last received
+  bool state_dirty_ = false;
+  bool have_state_ = false;
+  std::atomic<uint32_t> state_version_; // bumped with state_, 0 before the first
+  SyncState expected_state_; // Expected()'s copy of state_ at expected_version_
+  uint32_t expected_version_ = 0;
+
+  std::atomic<int64_t> offset_us_;
+  std::atomic<uint32_t> rtt_us_;
+  std::atomic<bool> have_offset_;
+  int64_t sample_offset_[SYNC_PING_SAMPLES];
+  uint32_t sample_rtt_[SYNC_PING_SAMPLES];
+  uint32_t samples_ = 0;
+};
+
+#endif
@@ -0,0 +1,178 @@
+/*
+* Live text layer, see ./hologram-text.h
+*/
+
+#include "hologram-text.h"
+#include "gpio.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define TEXT_REPORT 60 // updates between cost reports, a SetFormat() update reports at once
+
+// where Font draws the text, one byte per pixel
+class MaskCanvas : public rgb_matrix::Canvas
+{
+public:
+  MaskCanvas(int width, int height, uint8_t *mask) : width_(width), height_(height), mask_(mask) {}
+
+  virtual int width() const { return width_; }
+  virtual int height() const { return height_; }
+  virtual void SetPixel(int x, int y, uint8_t red, uint8_t green, uint8_t blue)
+  {
+    if( x < 0 || x >= width_ || y < 0 || y >= height_ ) return;
+    mask_[y * width_ + x] = (red | green | blue) != 0;
+  }
+  virtual void Clear() { memset(mask_, 0, (size_t)width_ * height_); }
+  virtual void Fill(uint8_t red, uint8_t green, uint8_t blue)
+  {
+    memset(mask_, (red | green | blue) != 0, (size_t)width_ * height_);
+  }
+
+private:
+  const int width_, height_;
+  uint8_t *const mask_;
+};
+
+TextLayer::TextLayer(const rgb_matrix::Font &font, Shape shape, const Pixel &color)
+  : font_(font), color_(color),
+    width_(shape == RING ? (int)lround(2 * M_PI * TEXT_RADIUS) : SLICE_COLS),
+    rows_(font.height() < SLICE_ROWS ? font.height() : SLICE_ROWS),
+    top_((SLICE_ROWS - rows_) / 2),
+    column_(SLICE_COUNT * SLICE_COLS, -1),
+    mask_((size_t)width_ * rows_, 0),
+    pending_(SLICE_COUNT, false),
+    reported_(true), update_us_(0), update_slices_(0), update_frames_(0),
+    count_(0), total_us_(0), max_us_(0), total_slices_(0)
+{
+  const double axis = (SLICE_COLS - 1) / 2.0;
+  for( size_t k = 0; k < SLICE_COUNT; k++ )
+  {
+    const double angle = 2 * M_PI * k / SLICE_COUNT;
+    for( size_t x = 0; x < SLICE_COLS; x++ )
+    {
+      // signed distance from the axis along the panel
+      const double s = x - axis;
+      int u = -1;
+      if( shape == FLAT )
+      {
+        if( fabs(s * sin(angle)) <= TEXT_DEPTH / 2.0 )
+          u = (int)floor(s * cos(angle) + SLICE_COLS / 2.0);
+      }
+      else if( fabs(fabs(s) - TEXT_RADIUS) <= TEXT_DEPTH / 2.0 )
+      {
+        // the half of the panel left of the axis faces the opposite way;
+        // text runs against the slice order so it reads left to right from outside
+        const double around = (angle + (s < 0 ? M_PI : 0)) / (2 * M_PI);
+        u = (int)floor(width_ / 2.0 - around * width_);
+        u = ((u % width_) + width_) % width_;
+      }
+      if( u >= width_ ) u = -1;
+      column_[k * SLICE_COLS + x] = u;
+    }
+  }
+}
+
+void TextLayer::SetFormat(const std::string &format)
+{
+  format_ = format;
+  announce_ = true;
+}
+
+void TextLayer::Rasterize(const std::string &text, std::vector<uint8_t> *mask) const
+{
+  // measure first, nothing lands on a canvas without columns
+  MaskCanvas measure(0, rows_, mask->data());
+  const rgb_matrix::Color white(255, 255, 255);
+  const int advance = rgb_matrix::DrawText(&measure, font_, 0, font_.baseline(), white, NULL, text.c_str());
+
+  MaskCanvas canvas(width_, rows_, mask->data());
+  canvas.Clear();
+  rgb_matrix::DrawText(&canvas, font_, (width_ - advance) / 2, font_.baseline(), white, NULL, text.c_str());
+}
+
+bool TextLayer::Render(SimpleFrame *out, int64_t shown_ms)
+{
+  // the text of the moment this frame is shown, not of when it's produced
+  const time_t shown = shown_ms / 1000;
+  struct tm tm;
+  localtime_r(&shown, &tm);
+  char formatted[256];
+  const size_t length = format_.empty() ? 0 : strftime(formatted, sizeof(formatted), format_.c_str(), &tm);
+  const std::string text(formatted, length);
+
+  if( text != text_ || announce_ )
+  {
+    std::vector<uint8_t> mask(mask_.size());
+    Rasterize(text, &mask);
+    std::vector<bool> changed(width_, false);
+    for( int r = 0; r < rows_; r++ )
+      for( int u = 0; u < width_; u++ )
+        if( mask[r * width_ + u] != mask_[r * width_ + u] ) changed[u] = true;
+    for( size_t k = 0; k < SLICE_COUNT; k++ )
+    {
+      for( size_t x = 0; x < SLICE_COLS && !pending_[k]; x++ )
+      {
+        const int u = column_[k * SLICE_COLS + x];
+        if( u >= 0 && changed[u] ) pending_[k] = true;
+      }
+    }
+    mask_.swap(mask);
+    text_ = text;
+    if( reported_ )
+    {
+      update_us_ = update_slices_ = update_frames_ = 0;
+      reported_ = false;
+    }
+  }
+  if( reported_ ) return false;
+
+  const uint32_t start = rgb_matrix::GetMicrosecondCounter();
+  bool drawn = false;
+  bool done = true;
+  for( size_t k = 0; k < SLICE_COUNT; k++ )
+  {
+    if( !pending_[k] ) continue;
+    if( drawn && rgb_matrix::GetMicrosecondCounter() - start > TEXT_BUDGET_US )
+    {
+      done = false;
+      break;
+    }
+    Pixel *pixels = out->slices[k].pixels;
+    const int16_t *columns = &column_[k * SLICE_COLS];
+    for( int r = 0; r < rows_; r++ )
+    {
+      const uint8_t *row = &mask_[r * width_];
+      Pixel *dst = pixels + (top_ + r) * SLICE_COLS;
+      for( size_t x = 0; x < SLICE_COLS; x++ )
+        dst[x] = columns[x] >= 0 && row[columns[x]] ? color_ : Pixel();
+    }
+    pending_[k] = false;
+    update_slices_++;
+    drawn = true;
+  }
+  update_us_ += rgb_matrix::GetMicrosecondCounter() - start;
+  update_frames_++;
+
+  if( done )
+  {
+    // printed every TEXT_REPORT ticks of a clock, and for each new text right away
+    reported_ = true;
+    count_++;
+    total_us_ += update_us_;
+    total_slices_ += update_slices_;
+    if( update_us_ > max_us_ ) max_us_ = update_us_;
+    if( announce_ )
+      printf("Text \"%s\": %u slices redrawn in %uus over %u frames\n",
+             text_.c_str(), update_slices_, update_us_, update_frames_);
+    else if( count_ >= TEXT_REPORT )
+      printf("Text updates: %u slices in %uus average, %uus max\n",
+             total_slices_ / count_, total_us_ / count_, max_us_);
+    if( announce_ || count_ >= TEXT_REPORT )
+      count_ = total_us_ = max_us_ = total_slices_ = 0;
+    announce_ = false;
+  }
+  return drawn;
+}
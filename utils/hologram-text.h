@@ -0,0 +1,67 @@
+/*
+* Live text in the volume, a layer drawn with a bdf font (see: ./hologram-layers.h)
+*
+* The text is a strftime() format, so "%H:%M:%S" is a clock and text without
+* fields stays as it is ("%%" for a literal '%'). Two shapes:
+*   FLAT: a sign in the plane of slice 0, TEXT_DEPTH columns thick
+*   RING: wrapped around the rotation axis at TEXT_RADIUS, read from outside
+*
+* Slice k shows the plane through the axis at 2*pi*k/SLICE_COUNT, the axis running
+* between the two middle columns. Which text column each slice column shows is
+* worked out once per shape; a text update then only redraws the slices showing a
+* text column that changed, at most TEXT_BUDGET_US of them per frame. The rest
+* follow in the next frames.
+*/
+
+#ifndef HOLOGRAM_TEXT_H
+#define HOLOGRAM_TEXT_H
+
+#include "hologram-layers.h"
+#include "graphics.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#define TEXT_DEPTH 4 // thickness of FLAT text in columns
+#define TEXT_RADIUS 24 // columns from the axis to the middle of RING text
+#define TEXT_BUDGET_US 1000 // redrawing per frame, a larger update spreads over frames
+
+class TextLayer : public Layer
+{
+public:
+  enum Shape { FLAT, RING };
+
+  // `font` must outlive the layer
+  TextLayer(const rgb_matrix::Font &font, Shape shape, const Pixel &color);
+
+  // the strftime format shown from the next frame on
+  void SetFormat(const std::string &format);
+
+  virtual bool Render(SimpleFrame *out, int64_t shown_ms);
+
+private:
+  void Rasterize(const std::string &text, std::vector<uint8_t> *mask) const;
+
+  const rgb_matrix::Font &font_;
+  const Pixel color_;
+  const int width_; // text columns around the shape
+  const int rows_;
+  const int top_; // slice row of the first text row
+  std::vector<int16_t> column_; // [slice][x] text column shown, -1 for none
+  std::string format_;
+  std::string text_; // last formatted
+  std::vector<uint8_t> mask_; // [row][column] drawn text, 1 where lit
+  std::vector<bool> pending_; // slices still showing an old text column
+
+  // cost of the update being drawn, counted in once all its slices are
+  bool reported_;
+  bool announce_ = false; // from SetFormat(), reported on its own
+  uint32_t update_us_;
+  uint32_t update_slices_;
+  uint32_t update_frames_;
+  uint32_t count_, total_us_, max_us_, total_slices_; // updates since the last report
+};
+
+#endif
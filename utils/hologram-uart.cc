@@ -0,0 +1,206 @@
+/*
+* Serial control channel, see ./hologram-uart.h
+*/
+
+#include "hologram-uart.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#ifndef CRTSCTS
+#define CRTSCTS  020000000000
+#endif
+
+static uint64_t MonotonicMillis()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool BaudToSpeed(int baud, speed_t *speed)
+{
+  switch( baud )
+  {
+    case 9600: *speed = B9600; return true;
+    case 19200: *speed = B19200; return true;
+    case 38400: *speed = B38400; return true;
+    case 57600: *speed = B57600; return true;
+    case 115200: *speed = B115200; return true;
+    case 230400: *speed = B230400; return true;
+    case 460800: *speed = B460800; return true;
+    case 921600: *speed = B921600; return true;
+    case 1000000: *speed = B1000000; return true;
+    case 2000000: *speed = B2000000; return true;
+    default: return false;
+  }
+}
+
+UartParser::UartParser()
+  : state_(WAIT_TYPE), type_(UART_REFRESH), header_(0), remaining_(0),
+    last_ms_(0), dropped_(0) {}
+
+void UartParser::Feed(const uint8_t *data, size_t size, uint64_t now_ms,
+                      const std::function<void(const UartMessage&)> &handle)
+{
+  // the rest of a frame never came, e.g. the sender restarted
+  if( state_ != WAIT_TYPE && now_ms - last_ms_ > UART_FRAME_TIMEOUT )
+  {
+    dropped_ += 1 + payload_.size();
+    state_ = WAIT_TYPE;
+  }
+  if( size > 0 ) last_ms_ = now_ms;
+
+  for( size_t i = 0; i < size; i++ )
+  {
+    const uint8_t b = data[i];
+    switch( state_ )
+    {
+      case WAIT_TYPE:
+        if( b < UART_FILE || b > UART_REFRESH )
+        {
+          dropped_++; // not a frame start, resync on the next byte
+          break;
+        }
+        type_ = (UartMessageType)b;
+        payload_.clear();
+        remaining_ = 0;
+        if( type_ == UART_REFRESH )
+        {
+          handle({ type_, payload_ });
+          break;
+        }
+        header_ = type_ == UART_FILE ? 2 : 1;
+        state_ = WAIT_LENGTH;
+        break;
+
+      case WAIT_LENGTH:
+        remaining_ = remaining_ << 8 | b;
+        if( --header_ > 0 ) break;
+        if( remaining_ > 0 )
+        {
+          state_ = WAIT_PAYLOAD;
+          break;
+        }
+        handle({ type_, payload_ });
+        state_ = WAIT_TYPE;
+        break;
+
+      case WAIT_PAYLOAD:
+        if( type_ == UART_FILE )
+        {
+          // not for the viewer, skip the whole run
+          const size_t skip = std::min<size_t>(remaining_, size - i);
+          remaining_ -= skip;
+          i += skip - 1;
+        }
+        else
+        {
+          payload_.push_back(b);
+          remaining_--;
+        }
+        if( remaining_ > 0 ) break;
+        handle({ type_, payload_ });
+        state_ = WAIT_TYPE;
+        break;
+    }
+  }
+}
+
+UartControl::UartControl() : fd_(-1) {}
+
+UartControl::~UartControl()
+{
+  Close();
+}
+
+bool UartControl::Open(const char *device, int baud)
+{
+  speed_t speed;
+  if( !BaudToSpeed(baud, &speed) )
+  {
+    fprintf(stderr, "%s: unsupported baud rate %d\n", device, baud);
+    return false;
+  }
+
+  fd_ = open(device, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+  if( fd_ < 0 )
+  {
+    fprintf(stderr, "%s: %s\n", device, strerror(errno));
+    return false;
+  }
+
+  // raw 8N1, no flow control, same as ./uart-test.c
+  struct termios tty;
+  if( tcgetattr(fd_, &tty) != 0 )
+  {
+    fprintf(stderr, "Error %i from tcgetattr: %s\n", errno, strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  tty.c_cflag &= ~PARENB;
+  tty.c_cflag &= ~CSTOPB;
+  tty.c_cflag &= ~CSIZE;
+  tty.c_cflag |= CS8;
+  tty.c_cflag &= ~CRTSCTS;
+  tty.c_cflag |= CREAD | CLOCAL;
+  tty.c_lflag &= ~ICANON;
+  tty.c_lflag &= ~ECHO;
+  tty.c_lflag &= ~ECHOE;
+  tty.c_lflag &= ~ECHONL;
+  tty.c_lflag &= ~ISIG;
+  tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+  tty.c_iflag &= ~(IGNBRK|BRKINT|PARMRK|ISTRIP|INLCR|IGNCR|ICRNL);
+  tty.c_oflag &= ~OPOST;
+  tty.c_oflag &= ~ONLCR;
+  tty.c_cc[VTIME] = 0;
+  tty.c_cc[VMIN] = 0;
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+  if( tcsetattr(fd_, TCSANOW, &tty) != 0 )
+  {
+    fprintf(stderr, "Error %i from tcsetattr: %s\n", errno, strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  tcflush(fd_, TCIFLUSH); // nothing from before we listened
+  return true;
+}
+
+bool UartControl::Read(const std::function<void(const UartMessage&)> &handle)
+{
+  if( fd_ < 0 ) return false;
+  uint8_t buf[256];
+  for( ;; )
+  {
+    const ssize_t n = read(fd_, buf, sizeof(buf));
+    if( n > 0 )
+    {
+      parser_.Feed(buf, n, MonotonicMillis(), handle);
+      continue;
+    }
+    // with VMIN = VTIME = 0 an empty port reads 0, even after a spurious wakeup;
+    // hangups are polled (EPOLLHUP), not read
+    if( n == 0 ) break;
+    if( errno == EAGAIN || errno == EWOULDBLOCK ) break;
+    if( errno == EINTR ) continue;
+    fprintf(stderr, "UART read: %s\n", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void UartControl::Close()
+{
+  if( fd_ >= 0 ) close(fd_);
+  fd_ = -1;
+}
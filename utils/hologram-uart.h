@@ -0,0 +1,90 @@
+/*
+* Serial control channel for hologram-viewer, replacing ./uart_rec.py and ./hologram-uart.py
+*
+* Frames, as sent by ./uart-send.py:
+*   0x01 size(2, big endian) <size bytes>   file transfer, skipped
+*   0x02 len(1) <name>                      change anim state
+*   0x03 len(1) <'L'/'R' ...>               swipe
+*   0x04                                    refresh
+*
+* The port is opened non-blocking with the termios setup of ./uart-test.c, the
+* viewer polls fd() next to its zmq socket and calls Read() when it's readable.
+* Any tty works, so it can be tried against a pseudo-terminal:
+*   $ socat pty,raw,echo=0,link=/tmp/holo-a pty,raw,echo=0,link=/tmp/holo-b
+*   $ hologram-viewer ... -U /tmp/holo-a
+*   $ printf '\x02\x04idle' > /tmp/holo-b
+*/
+
+#ifndef HOLOGRAM_UART_H
+#define HOLOGRAM_UART_H
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+
+#define UART_DEVICE "/dev/ttyS0"
+#define UART_BAUD 2000000
+#define UART_FRAME_TIMEOUT 100 // ms before a partial frame is dropped
+
+enum UartMessageType
+{
+  UART_FILE = 0x01,
+  UART_STATE = 0x02,
+  UART_SWIPE = 0x03,
+  UART_REFRESH = 0x04,
+};
+
+struct UartMessage
+{
+  UartMessageType type;
+  std::string payload; // anim name or swipe directions, empty otherwise
+};
+
+// splits a byte stream into messages, bytes may arrive in any chunks
+class UartParser
+{
+public:
+  UartParser();
+
+  void Feed(const uint8_t *data, size_t size, uint64_t now_ms,
+            const std::function<void(const UartMessage&)> &handle);
+
+  uint32_t dropped() const { return dropped_; } // bytes skipped resyncing or timed out
+
+private:
+  enum State { WAIT_TYPE, WAIT_LENGTH, WAIT_PAYLOAD };
+
+  State state_;
+  UartMessageType type_;
+  uint32_t header_; // length bytes still expected
+  uint32_t remaining_; // payload bytes still expected
+  std::string payload_;
+  uint64_t last_ms_;
+  uint32_t dropped_;
+};
+
+class UartControl
+{
+public:
+  UartControl();
+  ~UartControl();
+
+  // false with a message on stderr if `device` can't be set up
+  bool Open(const char *device, int baud);
+
+  int fd() const { return fd_; }
+
+  // read what's available once fd() polled readable, which may be nothing; false
+  // once the port is gone, fd() is left open for the caller to take out of its poll
+  bool Read(const std::function<void(const UartMessage&)> &handle);
+
+  // stop using the port, after a failed Read() or once it polled a hangup
+  void Close();
+
+private:
+  int fd_;
+  UartParser parser_;
+};
+
+#endif
@@ -0,0 +1,335 @@
+/*
+* Anim uploads, see ./hologram-upload.h
+*/
+
+#include "hologram-upload.h"
+#include "anim-format.h"
+#include "anim-writer.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#define UPLOAD_IDLE_TIMEOUT 60000 // ms without a chunk before an upload may be dropped
+
+static uint64_t MonotonicMillis()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool ValidName(const std::string &name)
+{
+  if( name.empty() || name.size() > UPLOAD_NAME_MAX || name[0] == '.' ) return false;
+  for( char c : name )
+    if( !isalnum((unsigned char)c) && c != '-' && c != '_' ) return false;
+  return true;
+}
+
+AnimUploader::AnimUploader(const std::string &dir) : dir_(dir), stop_(false)
+{
+  thread_ = std::thread(&AnimUploader::Run, this);
+}
+
+AnimUploader::~AnimUploader()
+{
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+  for( auto &u : uploads_ )
+  {
+    if( u.second.state != RECEIVING && u.second.state != COMPILING ) continue;
+    if( u.second.fd >= 0 ) close(u.second.fd);
+    unlink(UploadPath(u.first).c_str());
+  }
+}
+
+bool AnimUploader::Handles(const std::string &line)
+{
+  return line.compare(0, 8, ".upload ") == 0 || line.compare(0, 7, ".chunk ") == 0
+      || line.compare(0, 8, ".commit ") == 0 || line.compare(0, 10, ".uploaded ") == 0;
+}
+
+std::string AnimUploader::Request(const std::string &line, const uint8_t *data, size_t size)
+{
+  char name[UPLOAD_NAME_MAX + 2] = {0};
+  unsigned long long a = 0;
+  unsigned int b = 0;
+
+  if( sscanf(line.c_str(), ".upload %64s %llu %u", name, &a, &b) >= 2 )
+    return Start(name, a, b);
+  if( sscanf(line.c_str(), ".chunk %64s %llu", name, &a) == 2 )
+    return Chunk(name, a, data, size);
+  if( sscanf(line.c_str(), ".commit %64s", name) == 1 )
+    return Commit(name);
+  if( sscanf(line.c_str(), ".uploaded %64s", name) == 1 )
+    return Status(name);
+  return "FAIL request";
+}
+
+std::string AnimUploader::Start(const std::string &name, uint64_t size, uint32_t loop)
+{
+  if( !ValidName(name) ) return "FAIL name";
+  if( size == 0 || size > UPLOAD_MAX_BYTES ) return "FAIL size";
+
+  std::lock_guard<std::mutex> l(mutex_);
+  const uint64_t now = MonotonicMillis();
+  int open_count = 0;
+  for( auto it = uploads_.begin(); it != uploads_.end(); )
+  {
+    Upload &u = it->second;
+    // a client that went away, or a restart of this upload
+    if( u.state == RECEIVING && (it->first == name || now - u.start_ms > UPLOAD_IDLE_TIMEOUT) )
+    {
+      close(u.fd);
+      unlink(UploadPath(it->first).c_str());
+      it = uploads_.erase(it);
+      continue;
+    }
+    if( it->first == name && u.state == COMPILING ) return "FAIL busy";
+    if( u.state == RECEIVING || u.state == COMPILING ) open_count++;
+    ++it;
+  }
+  if( open_count >= UPLOAD_SESSIONS ) return "FAIL busy";
+
+  Upload u;
+  u.fd = open(UploadPath(name).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if( u.fd < 0 )
+  {
+    perror(UploadPath(name).c_str());
+    return "FAIL open";
+  }
+  u.size = size;
+  u.loop = loop;
+  u.start_ms = now;
+  uploads_[name] = u;
+  return "OK";
+}
+
+std::string AnimUploader::Chunk(const std::string &name, uint64_t offset, const uint8_t *data, size_t size)
+{
+  std::lock_guard<std::mutex> l(mutex_);
+  auto it = uploads_.find(name);
+  if( it == uploads_.end() || it->second.state != RECEIVING ) return "FAIL upload";
+  Upload &u = it->second;
+  if( offset > u.received || offset + size > u.size ) return "FAIL offset";
+
+  for( size_t done = 0; done < size; )
+  {
+    const ssize_t n = pwrite(u.fd, data + done, size - done, offset + done);
+    if( n < 0 && errno == EINTR ) continue;
+    if( n <= 0 )
+    {
+      perror(UploadPath(name).c_str());
+      return "FAIL write";
+    }
+    done += n;
+  }
+  if( offset + size > u.received ) u.received = offset + size;
+  u.start_ms = MonotonicMillis(); // idle time counts from the last chunk
+  return "OK";
+}
+
+std::string AnimUploader::Commit(const std::string &name)
+{
+  std::unique_lock<std::mutex> l(mutex_);
+  auto it = uploads_.find(name);
+  if( it == uploads_.end() || it->second.state != RECEIVING ) return "FAIL upload";
+  Upload &u = it->second;
+  if( u.received != u.size ) return "FAIL short";
+
+  close(u.fd);
+  u.fd = -1;
+  u.state = COMPILING;
+  queue_.push_back(name);
+  l.unlock();
+  wake_.notify_one();
+  return "OK";
+}
+
+std::string AnimUploader::Status(const std::string &name)
+{
+  std::lock_guard<std::mutex> l(mutex_);
+  auto it = uploads_.find(name);
+  if( it == uploads_.end() ) return "FAIL upload";
+  const Upload &u = it->second;
+  switch( u.state )
+  {
+    case RECEIVING:
+    case COMPILING:
+      return "BUSY";
+    case DONE:
+      return "DONE " + std::to_string(u.frames) + " " + std::to_string(u.compile_ms);
+    case FAILED:
+      break;
+  }
+  return "FAIL " + u.error;
+}
+
+void AnimUploader::Run()
+{
+  // compiling may take seconds of cpu and disk, only spend what nothing else wants
+  pthread_setname_np(pthread_self(), "holo-upload");
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+  std::unique_lock<std::mutex> l(mutex_);
+  while( true )
+  {
+    wake_.wait(l, [&](){ return stop_ || !queue_.empty(); });
+    if( stop_ ) break;
+    const std::string name = queue_.front();
+    queue_.pop_front();
+    const uint32_t loop = uploads_[name].loop;
+    l.unlock();
+
+    const uint64_t start = MonotonicMillis();
+    uint32_t frames = 0;
+    std::string error;
+    const bool ok = Compile(name, loop, &frames, &error);
+    unlink(UploadPath(name).c_str());
+    unlink(CompilePath(name).c_str());
+    const uint64_t took = MonotonicMillis() - start;
+    if( ok ) printf("Upload %s: %u frames compiled in %.3fs\n", name.c_str(), frames, took / 1000.0);
+    else fprintf(stderr, "Upload %s: %s\n", name.c_str(), error.c_str());
+
+    l.lock();
+    Upload &u = uploads_[name];
+    u.state = ok ? DONE : FAILED;
+    u.frames = frames;
+    u.compile_ms = took;
+    u.error = error;
+  }
+}
+
+bool AnimUploader::Compile(const std::string &name, uint32_t loop, uint32_t *frames, std::string *error)
+{
+  const std::string upload = UploadPath(name), compiled = CompilePath(name);
+  const std::string target = dir_ + name + ".anim";
+
+  std::ifstream in(upload, std::ios::in | std::ios::binary);
+  in.seekg(0, std::ios::end);
+  const uint64_t size = in.tellg();
+  in.seekg(0);
+
+  AnimHeader h;
+  AnimInfo info;
+  uint64_t head = 0;
+  in.read(reinterpret_cast<char*>(&h), sizeof(h));
+  const bool v1 = in && memcmp(h.magic, ANIM_MAGIC, 8) == 0;
+  const bool v2 = in && memcmp(h.magic, ANIM_MAGIC_V2, 8) == 0;
+  if( v1 || v2 )
+  {
+    if( v2 ) in.read(reinterpret_cast<char*>(&info), sizeof(info));
+    head = in.tellg();
+    if( !in || info.sliceCount != SLICE_COUNT || h.frameCount == 0
+        || (info.encoding != ANIM_RAW && info.encoding != ANIM_SLICE_TABLE
+            && info.encoding != ANIM_PALETTE_TABLE) )
+    {
+      *error = "unsupported .anim layout";
+      return false;
+    }
+    loop = h.loopStart;
+    *frames = h.frameCount;
+  }
+  else
+  {
+    // raw SimpleFrames
+    if( size % sizeof(SimpleFrame) != 0 )
+    {
+      *error = "not an .anim and not whole frames";
+      return false;
+    }
+    in.clear();
+    in.seekg(0);
+    *frames = size / sizeof(SimpleFrame);
+  }
+
+  if( info.encoding == ANIM_SLICE_TABLE || info.encoding == ANIM_PALETTE_TABLE )
+  {
+    // already compiled, check the references and register it as is
+    const bool indexed = info.encoding == ANIM_PALETTE_TABLE;
+    const uint64_t refs = (uint64_t)h.frameCount * SLICE_COUNT;
+    const uint64_t table = (indexed ? sizeof(IndexedSlice) : sizeof(Slice)) * (uint64_t)info.tableCount;
+    if( size != head + (indexed ? sizeof(AnimPalette) : 0) + sizeof(uint32_t) * refs + table )
+    {
+      *error = "slice table size mismatch";
+      return false;
+    }
+    if( indexed )
+    {
+      AnimPalette palette;
+      in.read(reinterpret_cast<char*>(&palette), sizeof(palette));
+      if( !in || palette.count > ANIM_PALETTE_MAX )
+      {
+        *error = "bad palette";
+        return false;
+      }
+    }
+    std::vector<uint32_t> ref(SLICE_COUNT);
+    for( uint64_t k = 0; k < h.frameCount; k++ )
+    {
+      in.read(reinterpret_cast<char*>(ref.data()), sizeof(uint32_t) * SLICE_COUNT);
+      for( uint32_t r : ref )
+      {
+        if( r >= info.tableCount )
+        {
+          *error = "slice reference out of range";
+          return false;
+        }
+      }
+    }
+    if( rename(upload.c_str(), target.c_str()) != 0 )
+    {
+      *error = std::string("register: ") + strerror(errno);
+      return false;
+    }
+    return true;
+  }
+
+  if( size != head + sizeof(SimpleFrame) * (uint64_t)*frames )
+  {
+    *error = "truncated frames";
+    return false;
+  }
+  // keep what a v2 ANIM_RAW header says about its slices, e.g. ANIM_HALF_TURN
+  AnimWriter writer(compiled, *frames, loop > *frames ? *frames : loop, true, false, info.flags);
+  std::unique_ptr<SimpleFrame> frame(new SimpleFrame());
+  for( uint32_t k = 0; k < *frames && writer.ok(); k++ )
+  {
+    in.read(reinterpret_cast<char*>(frame.get()), sizeof(SimpleFrame));
+    if( !in ) break;
+    writer.Write(*frame);
+  }
+  if( !in || !writer.Finish() )
+  {
+    *error = "compile failed";
+    return false;
+  }
+  // in place in one step, the viewer never sees a partial file under this name
+  if( rename(compiled.c_str(), target.c_str()) != 0 )
+  {
+    *error = std::string("register: ") + strerror(errno);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,83 @@
+/*
+* Anim uploads over the zmq control socket (see: ./holo-upload.py)
+*
+* Requests, each answered "OK" or "FAIL <reason>":
+*   .upload <name> <bytes> [loop]   start an upload, an .anim file or raw SimpleFrames
+*                                   (loop: frame raw frames return to, default 0)
+*   .chunk <name> <offset>\n<data>  data at `offset`, chunks in order; resending one is fine
+*   .commit <name>                  all bytes sent, compile in the background
+*   .uploaded <name>                "BUSY", "DONE <frames> <ms>" or "FAIL <reason>"
+*
+* The control thread only appends chunks to IMAGE_PATH/.<name>.upload. A worker
+* thread at idle priority then validates the upload and compiles raw frames and raw
+* .anims into slice table .anims (see: ./anim-writer.h). It registers the result by
+* renaming it to IMAGE_PATH/<name>.anim, which the viewer's inotify watch indexes.
+* Neither the display nor the producer thread ever waits on an upload.
+*/
+
+#ifndef HOLOGRAM_UPLOAD_H
+#define HOLOGRAM_UPLOAD_H
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define UPLOAD_MAX_BYTES (1u << 30) // largest upload
+#define UPLOAD_SESSIONS 4 // uploads open at once
+#define UPLOAD_NAME_MAX 63 // fits Command::name
+
+class AnimUploader
+{
+public:
+  // uploads land in `dir`, which must end in '/'
+  explicit AnimUploader(const std::string &dir);
+  ~AnimUploader();
+
+  // true for the requests above
+  static bool Handles(const std::string &line);
+
+  // handle one of the requests above, `data` is what follows the first line
+  std::string Request(const std::string &line, const uint8_t *data, size_t size);
+
+private:
+  enum State { RECEIVING, COMPILING, DONE, FAILED };
+
+  struct Upload
+  {
+    State state = RECEIVING;
+    int fd = -1;
+    uint64_t size = 0; // announced
+    uint64_t received = 0;
+    uint32_t loop = 0;
+    uint64_t start_ms = 0;
+    uint32_t frames = 0; // of the compiled anim
+    uint64_t compile_ms = 0;
+    std::string error;
+  };
+
+  std::string Start(const std::string &name, uint64_t size, uint32_t loop);
+  std::string Chunk(const std::string &name, uint64_t offset, const uint8_t *data, size_t size);
+  std::string Commit(const std::string &name);
+  std::string Status(const std::string &name);
+
+  void Run();
+  bool Compile(const std::string &name, uint32_t loop, uint32_t *frames, std::string *error);
+
+  std::string UploadPath(const std::string &name) const { return dir_ + "." + name + ".upload"; }
+  std::string CompilePath(const std::string &name) const { return dir_ + "." + name + ".compile"; }
+
+  const std::string dir_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::map<std::string, Upload> uploads_;
+  std::deque<std::string> queue_; // committed, waiting for the worker
+  bool stop_;
+  std::thread thread_;
+};
+
+#endif
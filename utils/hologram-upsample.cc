@@ -0,0 +1,54 @@
+/*
+* Angular upsampling, see ./hologram-upsample.h
+*/
+
+#include "hologram-upsample.h"
+
+#include <math.h>
+
+// channel value to light, the curve the matrix drives the leds with
+static double ToLight(int c, bool cie)
+{
+  if( !cie ) return c / 255.0;
+  const double l = c * 100.0 / 255.0;
+  return l <= 8 ? l / 902.3 : pow((l + 16) / 116.0, 3);
+}
+
+static int FromLight(double y, bool cie)
+{
+  double c = y * 255.0;
+  if( cie )
+  {
+    const double l = y <= 8 / 902.3 ? y * 902.3 : 116 * cbrt(y) - 16;
+    c = l * 255.0 / 100.0;
+  }
+  return c < 0 ? 0 : c > 255 ? 255 : (int)lround(c);
+}
+
+SliceUpsampler::SliceUpsampler(int factor, bool luminance_correct)
+  : factor_(factor < 1 ? 1 : factor > UPSAMPLE_MAX ? UPSAMPLE_MAX : factor)
+{
+  double light[256];
+  for( int c = 0; c < 256; c++ ) light[c] = ToLight(c, luminance_correct);
+
+  mix_.resize((size_t)(factor_ - 1) * 256 * 256);
+  for( int step = 1; step < factor_; step++ )
+  {
+    // both planes are equally far along every arc, so the weight only depends on the step
+    const double w = (double)step / factor_;
+    uint8_t *table = &mix_[(size_t)(step - 1) * 256 * 256];
+    for( int from = 0; from < 256; from++ )
+      for( int to = 0; to < 256; to++ )
+        table[from * 256 + to] = FromLight(light[from] * (1 - w) + light[to] * w, luminance_correct);
+  }
+}
+
+void SliceUpsampler::Between(const Slice &from, const Slice &to, int step, Slice *out) const
+{
+  const uint8_t *table = &mix_[(size_t)(step - 1) * 256 * 256];
+  for( size_t p = 0; p < SLICE_ROWS * SLICE_COLS; p++ )
+  {
+    const Pixel &a = from.pixels[p], &b = to.pixels[p];
+    out->pixels[p] = Pixel(table[a.r * 256 + b.r], table[a.g * 256 + b.g], table[a.b * 256 + b.b]);
+  }
+}
@@ -0,0 +1,42 @@
+/*
+* Angular upsampling: shows `factor` slices per stored slice (hologram-viewer -A)
+*
+* Stored slice k is the plane at angle 2*pi*k/SLICE_COUNT. The slices shown between
+* k and k+1 are resampled along the arcs between the two planes: a pixel sits at
+* the same radius and height on both, so it's interpolated by angle from the two
+* stored pixels. The tables are precomputed per step, one lookup per color channel.
+* Colors mix as light, through the panel's CIE1931 curve when the matrix uses it,
+* so a fading edge doesn't dip dark between slices.
+*
+* The producer works these out when it reads a frame, so anims keep SLICE_COUNT
+* slices on disk and the angular resolution scales with the motor instead.
+*/
+
+#ifndef HOLOGRAM_UPSAMPLE_H
+#define HOLOGRAM_UPSAMPLE_H
+
+#include "anim-format.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+#define UPSAMPLE_MAX 4 // shown slices per stored slice
+
+class SliceUpsampler
+{
+public:
+  // `factor` 1..UPSAMPLE_MAX; `luminance_correct` as the matrix maps colors
+  SliceUpsampler(int factor, bool luminance_correct);
+
+  int factor() const { return factor_; }
+
+  // the slice `step` (1..factor-1) of factor steps from `from` towards `to`
+  void Between(const Slice &from, const Slice &to, int step, Slice *out) const;
+
+private:
+  const int factor_;
+  std::vector<uint8_t> mix_; // [step - 1][from][to] channel value
+};
+
+#endif
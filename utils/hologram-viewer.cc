@@ -3,39 +3,91 @@
 *
 * Monitors SPIN_SYNC gpio to measure rotation
 * Starts zeromq server to receive LED controller commands (see: ./hologram-auto-controller.py)
-* Reads .anim files from IMAGE_PATH for all slice data (see: ./image-to-rgb)
+* Accepts anim uploads on the same socket (see: ./hologram-upload.h)
+* Optionally reads the same commands from a serial port (see: ./hologram-uart.h)
+* Optionally reads the swipe sensors itself (see: ./hologram-swipe.h)
+* Optionally locks frame clock and rotation offset to a leader hologram-viewer (see: ./hologram-sync.h)
+* Reads .anim files from IMAGE_PATH for all slice data (see: ./img2anim, ./anim-format.h)
 *
 * $ make -C .
 *
 * see --help for led configuration
 * common usage: hologram-viewer --led-rows=64 --led-cols=64 --led-pwm-dither-bits=2 --led-slowdown-gpio=2 --led-pwm-bits=3 --led-pwm-lsb-nanoseconds=50 --led-pixel-mapper="Rotate:270" --led-limit-refresh=1500
+*
+* -r <slices>  : rotation nudge per .l/.r command
+* -p <port>    : zmq control port (default 5555)
+* -S leader    : publish frame clock and rotation phase to followers
+* -S <host>    : follow the leader hologram-viewer at <host>
+* -c <slice>   : commit frame changes when this slice comes around (default 0, -1 = immediately)
+* -g           : pick pwm bits (up to --led-pwm-bits), dither bits and refresh limit for the rotation speed (see: ./hologram-governor.h)
+* -P <core>    : pin the producer thread to a cpu core
+* -C <core>    : pin the control (zmq) thread to a cpu core
+* -u           : report cpu usage of every thread each CPU_REPORT ms
+* -f <font>    : show a welcome and IP screen in this bdf font while loading
+* -w <seconds> : keep the welcome screen up at least this long after start (default 0)
+* -L <anim>    : show this anim as a layer in front of the others, repeatable (see: ./hologram-layers.h)
+* -U <device>  : read control frames from this serial port, e.g. /dev/ttyS0 (see: ./hologram-uart.h)
+* -B <baud>    : serial baud rate (default UART_BAUD)
+* -R <file>    : record SPIN_SYNC edges for ./spin-replay (see: ./hologram-rotation.h)
+* -l <us>      : add to the measured scanout latency the slice is picked ahead for, "off" picks for now
+* -M           : take frames from renderers through shared memory as anim "live" (see: ./holo-shm.h)
+* -t <font>    : bdf font of the .text and .ring layers (see: ./hologram-text.h)
+* -G <chip>    : read the swipe sensors from this gpiochip, e.g. /dev/gpiochip4 (see: ./hologram-swipe.h);
+*                run ./holo-autocontrol.py with --no-swipe next to it, the lines can only be requested once
+* -A <factor>  : show this many slices per stored slice, resampled in between (see: ./hologram-upsample.h)
+* -m           : keep showing slices while the motor is stopped or spinning up, e.g. on the bench
 */
 
 
 #include <zmq.hpp>
 
 #include "led-matrix.h"
+#include "graphics.h"
 #include "pixel-mapper.h"
 #include "content-streamer.h"
 #include "gpio.h"
 #include "hologram-viewer.h"
-
+#include "hologram-sync.h"
+#include "hologram-governor.h"
+#include "hologram-layers.h"
+#include "hologram-rotation.h"
+#include "hologram-shm.h"
+#include "hologram-swipe.h"
+#include "hologram-text.h"
+#include "hologram-uart.h"
+#include "hologram-upload.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <ifaddrs.h>
 #include <math.h>
+#include <net/if.h>
+#include <netinet/in.h>
 #include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <sstream>
 
 #include <algorithm>
 #include <map>
@@ -61,13 +113,33 @@ using rgb_matrix::StreamReader;
 #define SLICE_WRAP(slice) ((slice) % (SLICE_COUNT))
 
 #define FRAME_TIME 100 // duration of each frame in milliseconds
-#define QUEUE_SLOTS 30 // max frames to queue ahead
+#define QUEUE_SLOTS 30 // max frames to queue ahead, of SLICE_COUNT streams each (see: QueueDepth())
+#define COMMAND_SLOTS 16 // max commands waiting per consumer thread
+#define DISPLAY_LOG_SLOTS 16 // display loop messages waiting for the control thread to print them
+#define SLICE_CACHE_MAX 1024 // converted shared table slices kept per anim
+#define CONTROL_PORT 5555
+#define SYNC_SEEK_LEAD 3 // frames a follower seeks ahead of the leader
+#define SYNC_REPORT 50 // leader ticks between follower sync reports
+#define COMMIT_TIMEOUT 200 // ms a due frame waits for the commit slice, e.g. while the motor is stopped
+#define WAIT_TIMEOUT 100 // ms between interrupt_received checks while holding the splash
+#define MOTOR_IDLE_HZ 10 // refresh limit while the panel is blank
+#define MOTOR_IDLE_POLL_US 500 // sync pin sampling while the panel is blank
+#define CPU_REPORT 10000 // ms between thread cpu usage reports (-u)
+#define LATENCY_SMOOTHING 16 // samples the scanout latency estimate averages over
+#define LATENCY_SLEW 50 // us the slice lead may move per slice, keeps the slice index monotonic
+#define LATENCY_REPORT 10000 // ms between scanout latency reports
+#define SPLASH_INTERFACE "wlan0" // address shown on the splash screen (-f)
 
 /* GLOBALS */
 
 typedef int64_t tmillis_t;
 
-static std::thread zmq_thread;
+static tmillis_t GetTimeInMillis() {
+  struct timeval tp;
+  gettimeofday(&tp, NULL);
+  return tp.tv_sec * 1000 + tp.tv_usec / 1000;
+}
+
 volatile bool interrupt_received = false;
 
 static rgb_matrix::RGBMatrix *matrix;
@@ -97,15 +169,33 @@ public:
         return true;
     }
 
+    bool empty() {
+        return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire);
+    }
+
+    // queued elements, exact from the producer side
+    size_t size() {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        return (tail + cap_ - head_.load(std::memory_order_acquire)) % cap_;
+    }
+
     // non-blocking pop, returns false if empty
     bool pop(T &out) {
         size_t head = head_.load(std::memory_order_relaxed);
         if (head == tail_.load(std::memory_order_acquire)) return false; // empty
-        out = buf_[head];
+        out = std::move(buf_[head]); // the slot doesn't keep what it held alive
         head_.store((head + 1) % cap_, std::memory_order_release);
         return true;
     }
 
+    // copy of the oldest element without popping it, false if empty
+    bool front(T &out) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return false; // empty
+        out = buf_[head];
+        return true;
+    }
+
     bool isfull()
     {
       size_t tail = tail_.load(std::memory_order_relaxed);
@@ -129,45 +219,123 @@ private:
 constexpr static size_t HEADER_SIZE = sizeof(AnimHeader);
 constexpr static size_t FRAME_SIZE = sizeof(SimpleFrame);
 
-static std::string *next_anim_name, *active_anim_name;
-static volatile bool do_change_anim = false; // flag to switch anim
-static volatile bool do_next_frame = false; // flag to switch anim
-static uint32_t d_us = 0;
+// control thread -> producer/display, applied in order of arrival
+static SPSCQueue<Command> producer_commands(COMMAND_SLOTS + 1);
+static SPSCQueue<Command> display_commands(COMMAND_SLOTS + 1);
+// display -> producer, a sync follower's anim changes and seeks; one queue per pushing thread
+static SPSCQueue<Command> follower_commands(COMMAND_SLOTS + 1);
+static_assert(sizeof(Command::name) == sizeof(SyncTarget::anim), "follower commands carry the leader's anim name");
 
-static void InterruptHandler(int signo) {
-  interrupt_received = true;
+// producer side: a command from either queue is waiting
+static bool ProducerCommandsWaiting()
+{
+  return !producer_commands.empty() || !follower_commands.empty();
 }
 
-static uint32_t sync_prev = 0;
-static uint32_t rotation_angle = 0;
-static int32_t rotation_delta = 256;
-static int sync_level = 1;
-static uint32_t tick_prev = 0;
-static uint32_t rotation_history[8];
+// the producer sleeps on this while readyQueue is full and no command is waiting
+static std::mutex producer_mutex;
+static std::condition_variable producer_wake;
+static VolumeRing *volume_ring = nullptr; // -M, the producer sleeps on its futex while live
+static AnimUploader *uploader = nullptr; // control thread only
+static rgb_matrix::Font *text_font = nullptr; // -t, .text and .ring need it
+static SliceUpsampler *upsampler = nullptr; // -A, producer only
 
-static int32_t rot_inc = 1; 
+// after freeing a readyQueue slot or queueing a producer command
+static void WakeProducer()
+{
+  { std::lock_guard<std::mutex> l(producer_mutex); }
+  producer_wake.notify_one();
+  if( volume_ring ) volume_ring->Wake();
+}
+
+// runs a function on a rgb_matrix::Thread, to place it with Start(priority, affinity)
+class FunctionThread : public rgb_matrix::Thread
+{
+public:
+  FunctionThread(const char *name, std::function<void()> run) : name_(name), run_(run) {}
+  virtual void Run()
+  {
+    pthread_setname_np(pthread_self(), name_);
+    run_();
+  }
+private:
+  const char *const name_;
+  const std::function<void()> run_;
+};
 
-#define ROTATION_PRECISION 30
-#define ROTATION_FULL (1<<ROTATION_PRECISION)
-#define ROTATION_ZERO 286
-#define ROTATION_HISTORY 8
-#define ROTATION_HALF (1<<(ROTATION_PRECISION-1))
-#define ROTATION_MASK ((1<<ROTATION_PRECISION)-1)
+// cpu time per thread from /proc, printed as share of the time since the last report
+static void ReportThreadCPU()
+{
+  static std::map<int, unsigned long long> last_ticks;
+  static tmillis_t last_report = 0;
+  const tmillis_t now = GetTimeInMillis();
+  const long hz = sysconf(_SC_CLK_TCK);
+
+  std::string line = "CPU";
+  std::map<int, unsigned long long> ticks;
+  for( const auto &entry : fs::directory_iterator("/proc/self/task") )
+  {
+    std::ifstream stat(entry.path() / "stat");
+    std::string content;
+    std::getline(stat, content);
+    // pid (comm) state ... utime stime are fields 14 and 15
+    const size_t open = content.find('('), close = content.rfind(')');
+    if( open == std::string::npos || close == std::string::npos ) continue;
+    std::istringstream rest(content.substr(close + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    for( int f = 3; f <= 15 && rest >> field; f++ )
+    {
+      if( f == 14 ) utime = strtoull(field.c_str(), NULL, 10);
+      if( f == 15 ) stime = strtoull(field.c_str(), NULL, 10);
+    }
+    const int tid = atoi(entry.path().filename().c_str());
+    ticks[tid] = utime + stime;
+    if( last_report == 0 ) continue;
+
+    const double used = (ticks[tid] - last_ticks[tid]) * 1000.0 / hz;
+    char buf[64];
+    snprintf(buf, sizeof(buf), " %s/%d %.1f%%", content.substr(open + 1, close - open - 1).c_str(),
+             tid, 100.0 * used / std::max<tmillis_t>(1, now - last_report));
+    line += buf;
+  }
+  if( last_report != 0 ) printf("%s\n", line.c_str());
+  last_ticks.swap(ticks);
+  last_report = now;
+}
+static std::atomic<uint32_t> anim_generation(0); // bumped on each anim switch
+static uint32_t d_us = 0;
 
-static uint32_t rotation_zero = ROTATION_FULL / 360 * ROTATION_ZERO;
-// static bool rotation_stopped = true;
-static uint32_t rotation_period_raw = 0;
-static uint32_t rotation_period = 1<<26;
-// static bool rotation_lock = true;
-static int32_t rotation_drift = 0;
-static volatile int rot_off = 0;
+static RotationEstimator rotation; // display loop only
+static MotorMonitor motor; // display loop only
+static std::atomic<bool> motor_idle(false); // blank while stopped or spinning up, the producer pauses
 
+// display loop -> control thread: stdout may block, the display loop never writes it
+struct LogLine
+{
+  bool error = false; // for stderr
+  char text[192] = {0};
+};
+static SPSCQueue<LogLine> display_log(DISPLAY_LOG_SLOTS + 1);
+static int display_log_fd = -1; // eventfd, wakes the control thread for display_log
 
-static tmillis_t GetTimeInMillis() {
-  struct timeval tp;
-  gettimeofday(&tp, NULL);
-  return tp.tv_sec * 1000 + tp.tv_usec / 1000;
+// display loop only: printf for the control thread to print, dropped while it lags behind
+static void DisplayLog(bool error, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void DisplayLog(bool error, const char *format, ...)
+{
+  LogLine line;
+  line.error = error;
+  va_list ap;
+  va_start(ap, format);
+  vsnprintf(line.text, sizeof(line.text), format, ap);
+  va_end(ap);
+  if( display_log.push(line) && display_log_fd >= 0 ) eventfd_write(display_log_fd, 1);
 }
+static SpinRecorder *spin_recorder = nullptr; // -R
+
+static int32_t rot_inc = 1; 
+static int rot_off = 0; // owned by the display loop, see CMD_ROTATE
+
 
 // static void SleepMillis(tmillis_t milli_seconds) {
 //   if (milli_seconds <= 0) return;
@@ -177,59 +345,12 @@ static tmillis_t GetTimeInMillis() {
 //   nanosleep(&ts, NULL);
 // }
 
-int compare_ints(const void *a, const void *b) {
-  return *((int*)a) - *((int*)b);
-}
-
-static uint32_t median_period() {
-  static uint32_t sorted[ROTATION_HISTORY];
-  memcpy(sorted, rotation_history, sizeof(sorted));
-  qsort(sorted, ROTATION_HISTORY, sizeof(*sorted), compare_ints);
-
-  return (sorted[3] + sorted[4])/2;
-}
-
 static uint32_t rotation_current_angle(void) {
   uint32_t tick_curr = rgb_matrix::GetMicrosecondCounter();
-  uint32_t elapsed = tick_curr - sync_prev;
-  
-  static uint32_t current = 0;
-  
   int sync = (matrix->AwaitInputChange(0))>>SPIN_SYNC & 0b1;
-  if (sync != sync_level) {
-    sync_level = sync;
-    
-    if(sync == 0) {
-      sync_prev = tick_curr;
-      rotation_period_raw = elapsed;
-      if (elapsed > 10000) {
-        if (++current >= ROTATION_HISTORY) {
-            current = 0;
-        }
-        rotation_history[current] = elapsed;
-        rotation_period = median_period();
-        // std::cout << rotation_period << std::endl;
-
-        rotation_delta = ROTATION_FULL / rotation_period;
-        // if (rotation_lock) {
-        //     int recentre = ((int32_t)((rotation_angle + (!sync * ROTATION_HALF)) & ROTATION_MASK) - ROTATION_HALF) >> 17;
-        //     recentre = clamp(recentre, -rotation_delta / 16, rotation_delta / 16);
-        //     rotation_delta -= recentre;
-        // }
-      }
-    }
-  }
-
-  uint32_t dtick = (tick_curr - tick_prev);
-  tick_prev = tick_curr;
-
-  uint32_t delta = dtick * rotation_delta;
-
-  rotation_angle = (rotation_angle + delta) & ROTATION_MASK;
-
-  rotation_zero = (rotation_zero + ROTATION_FULL + (dtick * rotation_drift)) & ROTATION_MASK;
-
-  return (rotation_angle + rotation_zero) & ROTATION_MASK;
+  if (spin_recorder) spin_recorder->Sample(tick_curr, sync);
+  motor.Update(tick_curr, sync);
+  return rotation.Update(tick_curr, sync);
 }
 
 /*
@@ -250,56 +371,504 @@ static uint32_t rotation_current_angle(void) {
   
 */
 
-// create ifstream for .anim and get header data
-void ReadAnimFile(fs::path filepath, Anim &a)
+// position stream to read `frame` next
+void SeekAnimFrame(Anim &a, uint32_t frame)
+{
+  a.frame = frame;
+  a.stream.clear(); // clear EOF flag
+  a.stream.seekg(a.headHead + static_cast<std::streampos>( FRAME_SIZE * frame ));
+}
+
+// index an .anim file from its header only, false if it can't be played
+bool ReadAnimFile(fs::path filepath, Anim &a)
 {
-  a.stream.open(filepath, std::ios::in | std::ios::binary );
+  std::ifstream f(filepath, std::ios::in | std::ios::binary );
 
   AnimHeader h;
-  a.stream.read(reinterpret_cast<char*>(&h), HEADER_SIZE);
-  a.headHead = a.stream.tellg();
+  AnimInfo info;
+  f.read(reinterpret_cast<char*>(&h), HEADER_SIZE);
+  const bool v2 = memcmp(h.magic, ANIM_MAGIC_V2, 8) == 0;
+  if( !f || (!v2 && memcmp(h.magic, ANIM_MAGIC, 8) != 0) )
+  {
+    fprintf(stderr, "%s: not an .anim file\n", filepath.c_str());
+    return false;
+  }
+  if( v2 )
+    f.read(reinterpret_cast<char*>(&info), sizeof(AnimInfo));
+  if( !f || info.sliceCount != SLICE_COUNT || h.frameCount == 0
+      || (info.encoding != ANIM_RAW && info.encoding != ANIM_SLICE_TABLE
+          && info.encoding != ANIM_PALETTE_TABLE) )
+  {
+    fprintf(stderr, "%s: unsupported .anim layout\n", filepath.c_str());
+    return false;
+  }
+
+  // catch truncated files now rather than mid-show
+  const uintmax_t head = f.tellg();
+  const uintmax_t refs = sizeof(uint32_t) * (uintmax_t)h.frameCount * SLICE_COUNT;
+  uintmax_t size = FRAME_SIZE * (uintmax_t)h.frameCount;
+  if( info.encoding == ANIM_SLICE_TABLE )
+    size = refs + sizeof(Slice) * (uintmax_t)info.tableCount;
+  if( info.encoding == ANIM_PALETTE_TABLE )
+    size = sizeof(AnimPalette) + refs + sizeof(IndexedSlice) * (uintmax_t)info.tableCount;
+  std::error_code err;
+  if( fs::file_size(filepath, err) < head + size || err )
+  {
+    fprintf(stderr, "%s: truncated .anim file\n", filepath.c_str());
+    return false;
+  }
+
+  a.path = filepath;
+  a.encoding = info.encoding;
+  a.tableCount = info.tableCount;
+  a.halfTurn = (info.flags & ANIM_HALF_TURN) != 0;
+  a.headHead = head;
   a.frameCount = h.frameCount;
   a.loopStart = h.loopStart > h.frameCount ? h.frameCount : h.loopStart;
-  a.loopHead = a.headHead + static_cast<std::streampos>( FRAME_SIZE * a.loopStart );
+  a.entry = std::make_shared<const AnimIndex>(AnimIndex{ a.name, a.frameCount, a.loopStart });
+  return true;
+}
 
-  // // convert SimpleFrame to MemFrame for each frame
-  // for(size_t i = 0; i < h.frameCount; i++)
-  // {
-  //   SimpleFrame frame;
-  //   MemFrame memf;
-  //   f.read(reinterpret_cast<char*>(&frame), FRAME_SIZE);
+// open the stream and read the slice references of an indexed anim, on first use
+bool OpenAnim(Anim &a)
+{
+  if( a.broken )
+  {
+    fprintf(stderr, "%s: can't be played, replace it\n", a.path.c_str());
+    return false;
+  }
+  if( a.stream.is_open() ) return true;
+  a.stream.open(a.path, std::ios::in | std::ios::binary );
+  a.stream.seekg(a.headHead);
 
-  //   // store each slice in stream
-  //   for(size_t k = 0; k < SLICE_COUNT; k++)
-  //   {
-  //     rgb_matrix::StreamWriter out(&memf.slices[k]);
+  if( a.encoding == ANIM_PALETTE_TABLE )
+  {
+    // map the colors to bitplane bits once, slices then convert by table lookup
+    std::unique_ptr<AnimPalette> p(new AnimPalette());
+    a.stream.read(reinterpret_cast<char*>(p.get()), sizeof(AnimPalette));
+    a.colors.assign(p->colors, p->colors + ANIM_PALETTE_MAX);
+    std::vector<rgb_matrix::Color> colors;
+    for( const Pixel &c : a.colors ) colors.push_back(rgb_matrix::Color(c.r, c.g, c.b));
+    a.palette.reset(new rgb_matrix::FramePalette(colors.data(), colors.size()));
+  }
 
-  //     for (size_t y = 0; y < SLICE_ROWS; ++y) {
-  //       for (size_t x = 0; x < SLICE_COLS; ++x) {
-  //         const Pixel p = frame.slices[k].GetPixel(x, y);
-  //         reader_canvas->SetPixel(x, y, p.r, p.g, p.b);
-  //       }
-  //     }
+  if( a.encoding == ANIM_SLICE_TABLE || a.encoding == ANIM_PALETTE_TABLE )
+  {
+    a.refs.resize((size_t)a.frameCount * SLICE_COUNT);
+    a.stream.read(reinterpret_cast<char*>(a.refs.data()), sizeof(uint32_t) * a.refs.size());
+    a.tableHead = a.stream.tellg();
+    a.shared.assign(a.tableCount, false);
+    std::vector<uint8_t> uses(a.tableCount, 0);
+    for( uint32_t &ref : a.refs )
+    {
+      if( ref >= a.tableCount )
+      {
+        fprintf(stderr, "%s: slice reference out of range\n", a.path.c_str());
+        a.stream.close();
+        return false;
+      }
+      if( uses[ref] < 2 && ++uses[ref] == 2 ) a.shared[ref] = true;
+    }
+    a.cache.assign(a.tableCount, nullptr);
+    a.cached = 0;
+    a.between.clear();
+  }
 
-  //     out.Stream(*reader_canvas, 0); // out writes to StreamIO memf[k]
-  //   }
+  a.loopHead = a.stream.tellg() + static_cast<std::streamoff>( FRAME_SIZE * a.loopStart );
+  if( !a.stream )
+  {
+    fprintf(stderr, "%s: can't read\n", a.path.c_str());
+    a.stream.close();
+    return false;
+  }
+  SeekAnimFrame(a, 0);
+  return true;
+}
 
-  //   a.sequence.push_back(memf);
-  // }
+// close an anim that stopped playing, dropping its references and converted slices
+void CloseAnim(Anim &a)
+{
+  a.stream.close();
+  std::vector<uint32_t>().swap(a.refs);
+  std::vector<bool>().swap(a.shared);
+  std::vector<SliceStream>().swap(a.cache);
+  a.cached = 0;
+  a.between.clear();
+  std::vector<Pixel>().swap(a.colors);
+  a.palette.reset();
 }
 
-MemFrame EmptyFrame()
+// convert slice pixels to a displayable stream
+SliceStream ConvertSlice(const Slice &slice)
 {
-  MemFrame memf;
+  SliceStream stream = std::make_shared<rgb_matrix::MemStreamIO>();
+  rgb_matrix::StreamWriter out(stream.get());
+  for (size_t y = 0; y < SLICE_ROWS; ++y) {
+    for (size_t x = 0; x < SLICE_COLS; ++x) {
+      const Pixel p = slice.GetPixel(x, y);
+      reader_canvas->SetPixel(x, y, p.r, p.g, p.b);
+    }
+  }
+  out.Stream(*reader_canvas, 0); // out writes to StreamIO
+  return stream;
+}
+
+// convert palette indices of an ANIM_PALETTE_TABLE slice to a displayable stream
+static SliceStream ConvertIndexedSlice(const IndexedSlice &slice, const rgb_matrix::FramePalette &palette)
+{
+  SliceStream stream = std::make_shared<rgb_matrix::MemStreamIO>();
+  rgb_matrix::StreamWriter out(stream.get());
+  reader_canvas->SetPixelsIndexed(0, 0, SLICE_COLS, SLICE_ROWS, palette, slice.indices);
+  out.Stream(*reader_canvas, 0);
+  return stream;
+}
+
+// read slice `ref` of an ANIM_PALETTE_TABLE slice table
+static void ReadTableIndexed(Anim &a, uint32_t ref, IndexedSlice &out)
+{
+  a.stream.clear();
+  a.stream.seekg(a.tableHead + static_cast<std::streampos>( sizeof(IndexedSlice) * ref ));
+  a.stream.read(reinterpret_cast<char*>(&out), sizeof(IndexedSlice));
+}
+
+// read slice `ref` of the slice table as colors
+static void ReadTableSlice(Anim &a, uint32_t ref, Slice &out)
+{
+  if( a.encoding == ANIM_PALETTE_TABLE )
+  {
+    IndexedSlice indexed;
+    ReadTableIndexed(a, ref, indexed);
+    for( size_t p = 0; p < SLICE_ROWS * SLICE_COLS; p++ ) out.pixels[p] = a.colors[indexed.indices[p]];
+    return;
+  }
+  a.stream.clear();
+  a.stream.seekg(a.tableHead + static_cast<std::streampos>( sizeof(Slice) * ref ));
+  a.stream.read(reinterpret_cast<char*>(&out), sizeof(Slice));
+}
+
+// slice with the layer overlay drawn on, kept while neither part changes (producer thread)
+struct ComposedSlice
+{
+  const Anim *anim = nullptr;
+  uint32_t base = 0; // table reference or frame number within `anim`
+  uint32_t version = 0; // LayerStack::version() of the overlay
+  SliceStream stream;
+};
+static ComposedSlice composed[SLICE_COUNT];
+
+static bool IsComposed(const Anim &a, uint32_t base, size_t k, const LayerStack &layers)
+{
+  const ComposedSlice &c = composed[k];
+  return c.stream && c.anim == &a && c.base == base && c.version == layers.version(k);
+}
+
+static void Compose(const Anim &a, uint32_t base, size_t k, const LayerStack &layers, Slice &pixels)
+{
+  layers.Compose(k, &pixels);
+  ComposedSlice &c = composed[k];
+  c.anim = &a;
+  c.base = base;
+  c.version = layers.version(k);
+  c.stream = ConvertSlice(pixels);
+}
+
+// index a closed anim again after its file was replaced, false if the new file can't be played.
+// Frames the display may still show keep the AnimIndex they were read with
+static bool ReindexAnim(Anim &a)
+{
+  a.stale = false;
+  a.broken = !ReadAnimFile(a.path, a);
+  for( ComposedSlice &c : composed )
+    if( c.anim == &a ) c = ComposedSlice();
+  return !a.broken;
+}
+
+// read and convert frame a.frame; slices shared through the slice table are converted once,
+// slices covered by `layers` are composited and converted only when either part changed
+void ReadFrame(Anim &a, MemFrame &out, SimpleFrame &data, const LayerStack *layers)
+{
+  if( a.encoding == ANIM_SLICE_TABLE || a.encoding == ANIM_PALETTE_TABLE )
+  {
+    IndexedSlice indexed;
+    const uint32_t *refs = &a.refs[(size_t)a.frame * SLICE_COUNT];
+    for(size_t k = 0; k < SLICE_COUNT; k++)
+    {
+      const uint32_t ref = refs[k];
+      if( layers && layers->Covers(k) )
+      {
+        if( !IsComposed(a, ref, k, *layers) )
+        {
+          ReadTableSlice(a, ref, data.slices[k]);
+          Compose(a, ref, k, *layers, data.slices[k]);
+        }
+        out.slices[k] = composed[k].stream;
+        continue;
+      }
+      if( a.cache[ref] )
+      {
+        out.slices[k] = a.cache[ref];
+        continue;
+      }
+      if( a.palette )
+      {
+        ReadTableIndexed(a, ref, indexed);
+        out.slices[k] = ConvertIndexedSlice(indexed, *a.palette);
+      }
+      else
+      {
+        ReadTableSlice(a, ref, data.slices[k]);
+        out.slices[k] = ConvertSlice(data.slices[k]);
+      }
+      if( a.shared[ref] && a.cached < SLICE_CACHE_MAX )
+      {
+        a.cache[ref] = out.slices[k];
+        a.cached++;
+      }
+    }
+    return;
+  }
+
+  a.stream.read(reinterpret_cast<char*>(&data), FRAME_SIZE);
+  for(size_t k = 0; k < SLICE_COUNT; k++)
+  {
+    if( layers && layers->Covers(k) )
+    {
+      if( !IsComposed(a, a.frame, k, *layers) ) Compose(a, a.frame, k, *layers, data.slices[k]);
+      out.slices[k] = composed[k].stream;
+    }
+    else
+      out.slices[k] = ConvertSlice(data.slices[k]);
+  }
+}
+
+// read the pixels of frame a.frame, without converting
+static void ReadFramePixels(Anim &a, SimpleFrame &data)
+{
+  if( a.encoding == ANIM_SLICE_TABLE || a.encoding == ANIM_PALETTE_TABLE )
+  {
+    const uint32_t *refs = &a.refs[(size_t)a.frame * SLICE_COUNT];
+    for(size_t k = 0; k < SLICE_COUNT; k++)
+      ReadTableSlice(a, refs[k], data.slices[k]);
+    return;
+  }
+  a.stream.read(reinterpret_cast<char*>(&data), FRAME_SIZE);
+}
+
+// -A: convert the slices shown between slices[k] and slices[k + 1], `next` following the last one
+static void UpsampleSlices(const Slice *const *slices, const Slice &next, SliceStream (*between)[UPSAMPLE_MAX - 1])
+{
+  std::unique_ptr<Slice> mixed(new Slice());
+  for(size_t k = 0; k < SLICE_COUNT; k++)
+  {
+    for(int step = 1; step < upsampler->factor(); step++)
+    {
+      upsampler->Between(*slices[k], k + 1 < SLICE_COUNT ? *slices[k + 1] : next, step, mixed.get());
+      between[k][step - 1] = ConvertSlice(*mixed);
+    }
+  }
+}
+
+// -A: convert the slices shown between the stored ones
+static void UpsampleFrame(const Slice *const *slices, MemFrame &out)
+{
+  UpsampleSlices(slices, *slices[0], out.between);
+}
+
+// -A: like ReadFrame, but both neighbours' pixels are needed for the slices between them.
+// Like there, slice table slices are converted once when shared, and so are the slices
+// between two shared ones; slices covered by `layers` are converted every frame
+static void ReadFrameUpsampled(Anim &a, MemFrame &out, SimpleFrame &data, const LayerStack *layers)
+{
+  if( a.encoding != ANIM_SLICE_TABLE && a.encoding != ANIM_PALETTE_TABLE )
+  {
+    ReadFramePixels(a, data);
+    const Slice *slices[SLICE_COUNT];
+    for(size_t k = 0; k < SLICE_COUNT; k++)
+    {
+      if( layers && layers->Covers(k) ) layers->Compose(k, &data.slices[k]);
+      out.slices[k] = ConvertSlice(data.slices[k]);
+      slices[k] = &data.slices[k];
+    }
+    UpsampleFrame(slices, out);
+    return;
+  }
+
+  const uint32_t *refs = &a.refs[(size_t)a.frame * SLICE_COUNT];
+  bool loaded[SLICE_COUNT] = {};
+  // pixels are only read for what isn't cached
+  auto pixels = [&](size_t k) -> const Slice& {
+    if( !loaded[k] )
+    {
+      ReadTableSlice(a, refs[k], data.slices[k]);
+      if( layers && layers->Covers(k) ) layers->Compose(k, &data.slices[k]);
+      loaded[k] = true;
+    }
+    return data.slices[k];
+  };
+  auto cacheable = [&](size_t k) { return a.shared[refs[k]] && !(layers && layers->Covers(k)); };
+
+  const int steps = upsampler->factor() - 1;
+  std::unique_ptr<Slice> mixed(new Slice());
   for(size_t k = 0; k < SLICE_COUNT; k++)
   {
-    rgb_matrix::StreamWriter out(&memf.slices[k]);
-    for (size_t y = 0; y < SLICE_ROWS; ++y) {
-      for (size_t x = 0; x < SLICE_COLS; ++x) {
-        reader_canvas->SetPixel(x, y, 0, 0, 0);
+    const uint32_t ref = refs[k];
+    if( cacheable(k) && a.cache[ref] )
+      out.slices[k] = a.cache[ref];
+    else
+    {
+      out.slices[k] = ConvertSlice(pixels(k));
+      if( cacheable(k) && a.cached < SLICE_CACHE_MAX )
+      {
+        a.cache[ref] = out.slices[k];
+        a.cached++;
       }
     }
-    out.Stream(*reader_canvas, 0); // out writes to StreamIO memf[k]
+
+    const size_t next = SLICE_WRAP(k + 1);
+    const bool pair = cacheable(k) && cacheable(next);
+    const uint64_t key = (uint64_t)ref << 32 | refs[next];
+    const auto hit = pair ? a.between.find(key) : a.between.end();
+    if( hit != a.between.end() )
+    {
+      for(int step = 0; step < steps; step++) out.between[k][step] = hit->second[step];
+      continue;
+    }
+    for(int step = 1; step <= steps; step++)
+    {
+      upsampler->Between(pixels(k), pixels(next), step, mixed.get());
+      out.between[k][step - 1] = ConvertSlice(*mixed);
+    }
+    if( pair && a.cached + steps <= SLICE_CACHE_MAX )
+    {
+      std::array<SliceStream, UPSAMPLE_MAX - 1> &cached = a.between[key];
+      for(int step = 0; step < steps; step++) cached[step] = out.between[k][step];
+      a.cached += steps;
+    }
+  }
+}
+
+// the plane of `in` seen from behind, its columns the other way around the axis
+static void MirrorSlice(const Slice &in, Slice &out)
+{
+  for (size_t y = 0; y < SLICE_ROWS; ++y)
+    for (size_t x = 0; x < SLICE_COLS; ++x)
+      out.pixels[y * SLICE_COLS + x] = in.pixels[y * SLICE_COLS + SLICE_COLS - 1 - x];
+}
+
+// ANIM_HALF_TURN: slice k is the plane at pi*k/SLICE_COUNT, back[k] the same one half a turn
+// later. Layer slices are a full turn apart, each plane gets the one at or just before it.
+static void ReadFrameHalfTurn(Anim &a, MemFrame &out, SimpleFrame &data, const LayerStack *layers)
+{
+  static std::unique_ptr<SimpleFrame> mirrored(new SimpleFrame()); // producer thread only
+  ReadFramePixels(a, data);
+  const Slice *front[SLICE_COUNT], *back[SLICE_COUNT];
+  for(size_t k = 0; k < SLICE_COUNT; k++)
+  {
+    MirrorSlice(data.slices[k], mirrored->slices[k]);
+    const size_t j = k / 2, j_back = j + SLICE_COUNT / 2;
+    if( layers && layers->Covers(j) ) layers->Compose(j, &data.slices[k]);
+    if( layers && layers->Covers(j_back) ) layers->Compose(j_back, &mirrored->slices[k]);
+    out.slices[k] = ConvertSlice(data.slices[k]);
+    out.back[k] = ConvertSlice(mirrored->slices[k]);
+    front[k] = &data.slices[k];
+    back[k] = &mirrored->slices[k];
+  }
+  out.half_turn = true;
+  if( upsampler )
+  {
+    // each half ends where the other one starts
+    UpsampleSlices(front, *back[0], out.between);
+    UpsampleSlices(back, *front[0], out.back_between);
+  }
+}
+
+// ANIM_HALF_TURN slices as the full turn of planes a layer is drawn in, every other one
+static void ExpandHalfTurn(SimpleFrame &frame)
+{
+  for(size_t j = 0; j < SLICE_COUNT / 2; j++)
+    frame.slices[j] = frame.slices[2 * j];
+  for(size_t j = SLICE_COUNT / 2; j < SLICE_COUNT; j++)
+    MirrorSlice(frame.slices[j - SLICE_COUNT / 2], frame.slices[j]);
+}
+
+// step to the next frame, looping to loopStart
+static void AdvanceAnim(Anim &a)
+{
+  if(++a.frame >= a.frameCount)
+  {
+    a.frame = a.loopStart >= a.frameCount ? a.frameCount - 1 : a.loopStart;
+    a.stream.clear();  // clear EOF flag
+    a.stream.seekg(a.loopHead);
+  }
+}
+
+// frames to queue ahead of `a`: upsampled and half turn frames carry more streams,
+// fewer of them fit in the memory of QUEUE_SLOTS plain frames
+static size_t QueueDepth(const Anim &a)
+{
+  const size_t streams = (upsampler ? upsampler->factor() : 1) * (a.halfTurn ? 2 : 1);
+  return std::max<size_t>(2, QUEUE_SLOTS / streams);
+}
+
+// read the current frame of `a` into `out` with `layers` in front and advance both,
+// `shown_ms` is when the frame will be on display
+void ProduceFrame(Anim &a, MemFrame &out, SimpleFrame &data, LayerStack &layers, tmillis_t shown_ms)
+{
+  out.anim = &a;
+  out.entry = a.entry;
+  out.index = a.frame;
+  layers.Update(shown_ms);
+  const uint32_t start_us = rgb_matrix::GetMicrosecondCounter();
+  if( a.halfTurn ) ReadFrameHalfTurn(a, out, data, layers.empty() ? nullptr : &layers);
+  else if( upsampler ) ReadFrameUpsampled(a, out, data, layers.empty() ? nullptr : &layers);
+  else ReadFrame(a, out, data, layers.empty() ? nullptr : &layers);
+  // the queue drains if this keeps up, e.g. -A too large for the cpu; tell once per anim
+  const uint32_t took_us = rgb_matrix::GetMicrosecondCounter() - start_us;
+  if( took_us > FRAME_TIME * 1000 && !a.slow )
+  {
+    fprintf(stderr, "%s frame %u took %.1fms to produce, longer than it shows (-A %d)\n",
+            a.name.c_str(), out.index, took_us / 1000.0, upsampler ? upsampler->factor() : 1);
+    a.slow = true;
+  }
+  AdvanceAnim(a);
+}
+
+// convert the newest volume from shared memory and set `head` to the ring head it was
+// published under, false if the writer is in its slot or overwrote it meanwhile
+static bool ProduceLiveFrame(Anim &live, MemFrame &out, SimpleFrame &data, LayerStack &layers, uint32_t &head)
+{
+  uint32_t seq;
+  const SimpleFrame *frame = volume_ring->Latest(&seq, &head);
+  if( !frame ) return false;
+
+  out.anim = &live;
+  out.entry = live.entry;
+  out.index = 0;
+  layers.Update(GetTimeInMillis()); // never queued behind others
+  const Slice *slices[SLICE_COUNT];
+  for(size_t k = 0; k < SLICE_COUNT; k++)
+  {
+    slices[k] = &frame->slices[k];
+    if( !layers.empty() && layers.Covers(k) )
+    {
+      // the only copy, the overlay must not be drawn into the writer's slot
+      data.slices[k] = frame->slices[k];
+      layers.Compose(k, &data.slices[k]);
+      slices[k] = &data.slices[k];
+    }
+    out.slices[k] = ConvertSlice(*slices[k]);
+  }
+  if( upsampler ) UpsampleFrame(slices, out);
+  return volume_ring->Intact(frame, seq);
+}
+
+MemFrame EmptyFrame()
+{
+  MemFrame memf;
+  const SliceStream blank = ConvertSlice(Slice());
+  for(size_t k = 0; k < SLICE_COUNT; k++)
+  {
+    memf.slices[k] = blank;
   }
   return memf;
 }
@@ -344,15 +913,90 @@ int RetrieveAnimList(std::map< std::string, Anim > &new_list)
   {
     if(entry.path().extension().string() == ".anim" )
     {
-      // todo: check if already exists?
+      if( new_list.count(entry.path().stem()) != 0 ) continue; // may be playing
       new_list[entry.path().stem()] = Anim();
-      ReadAnimFile( entry.path(), new_list[entry.path().stem()] );
+      new_list[entry.path().stem()].name = entry.path().stem();
+      if( !ReadAnimFile( entry.path(), new_list[entry.path().stem()] ) )
+      {
+        new_list.erase(entry.path().stem());
+        continue;
+      }
       i++;
     }
   }
   return i;
 }
 
+// an .anim played as a layer, on its own stream so it can also play underneath
+class AnimLayer : public Layer
+{
+public:
+  bool Open(const fs::path &path)
+  {
+    anim_.name = path.stem();
+    return ReadAnimFile(path, anim_) && OpenAnim(anim_);
+  }
+
+  virtual bool Render(SimpleFrame *out, int64_t shown_ms)
+  {
+    // holds on the last frame once an anim without loop ended
+    if( rendered_ && anim_.frame == last_ ) return false;
+    last_ = anim_.frame;
+    rendered_ = true;
+    ReadFramePixels(anim_, *out);
+    if( anim_.halfTurn ) ExpandHalfTurn(*out);
+    AdvanceAnim(anim_);
+    return true;
+  }
+
+private:
+  Anim anim_;
+  uint32_t last_ = 0;
+  bool rendered_ = false;
+};
+
+// show anim `name` as the top layer, false if it can't
+static bool AddAnimLayer(std::map< std::string, Anim > &AnimList, LayerStack &layers, const std::string &name)
+{
+  if( AnimList.count(name) == 0 )
+    RetrieveAnimList(AnimList); // reload anim list
+  if( AnimList.count(name) == 0 )
+  {
+    fprintf(stderr, "No anim named \"%s\"\n", name.c_str());
+    return false;
+  }
+  std::unique_ptr<AnimLayer> layer(new AnimLayer());
+  if( !layer->Open(AnimList[name].path) ) return false;
+  if( !layers.Add(name, std::move(layer)) )
+  {
+    fprintf(stderr, "Can't add layer \"%s\", at most %d\n", name.c_str(), LAYER_MAX);
+    return false;
+  }
+  return true;
+}
+
+// show `format` as the text layer of `shape`, hide it if empty; false if nothing changed
+static bool SetTextLayer(LayerStack &layers, TextLayer::Shape shape, const std::string &format)
+{
+  const std::string name = shape == TextLayer::RING ? ".ring" : ".text";
+  if( format.empty() ) return layers.Remove(name);
+
+  TextLayer *shown = static_cast<TextLayer*>(layers.Get(name));
+  if( shown )
+  {
+    shown->SetFormat(format);
+    return true;
+  }
+  std::unique_ptr<TextLayer> layer(new TextLayer(*text_font, shape, Pixel(255, 255, 255)));
+  layer->SetFormat(format);
+  if( !layers.Add(name, std::move(layer)) )
+  {
+    fprintf(stderr, "Can't add layer \"%s\", at most %d\n", name.c_str(), LAYER_MAX);
+    return false;
+  }
+  return true;
+}
+
 // void SwitchAnim(std::map< std::string, Anim > &AnimList)
 // {
 
@@ -367,53 +1011,344 @@ int RetrieveAnimList(std::map< std::string, Anim > &new_list)
 //   active_anim_name = next_anim_name;
 // }
 
-void zmq_loop (void* s)
+// IPv4 address of SPLASH_INTERFACE, or of the first other interface that is up
+static std::string LocalAddress()
+{
+  struct ifaddrs *list;
+  if( getifaddrs(&list) != 0 ) return "";
+
+  std::string found;
+  for( struct ifaddrs *ifa = list; ifa; ifa = ifa->ifa_next )
+  {
+    if( !ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET ) continue;
+    if( (ifa->ifa_flags & IFF_LOOPBACK) || !(ifa->ifa_flags & IFF_UP) ) continue;
+
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &((struct sockaddr_in*)ifa->ifa_addr)->sin_addr, addr, sizeof(addr));
+    if( strcmp(ifa->ifa_name, SPLASH_INTERFACE) == 0 )
+    {
+      found = addr;
+      break;
+    }
+    if( found.empty() ) found = addr;
+  }
+  freeifaddrs(list);
+  return found;
+}
+
+// welcome text and IP, centered, shown flat while everything loads
+static void DrawSplash(FrameCanvas *canvas, const rgb_matrix::Font &font)
+{
+  const std::string address = LocalAddress();
+  const char *lines[] = { "Welcome!", "", "Display", "starting...", "", "IP",
+                          address.empty() ? "no network" : address.c_str() };
+  const int count = sizeof(lines) / sizeof(lines[0]);
+  const rgb_matrix::Color color(255, 255, 255);
+
+  canvas->Clear();
+  int y = (canvas->height() - count * font.height()) / 2;
+  for( int l = 0; l < count; l++ )
+  {
+    int width = 0;
+    for( const char *c = lines[l]; *c; c++ ) width += std::max(0, font.CharacterWidth(*c));
+    rgb_matrix::DrawText(canvas, font, (canvas->width() - width) / 2, y + font.baseline(),
+                         color, NULL, lines[l]);
+    y += font.height();
+  }
+}
+
+// queue a text control command, see zmq_loop; false if unknown or the queue is full
+static bool QueueRequest(const std::string &r, uint32_t received_us)
+{
+  Command cmd;
+  cmd.received_us = received_us;
+  bool queued = false;
+
+  if( r[0] == '.' )
+  {
+    if( r == ".l" || r == ".r" )
+    {
+      cmd.type = CMD_ROTATE;
+      cmd.value = r == ".l" ? -rot_inc : rot_inc;
+      queued = display_commands.push(cmd);
+    }
+    if( r == ".n")
+    {
+      cmd.type = CMD_NEXT_FRAME;
+      queued = display_commands.push(cmd);
+    }
+    // ".latency <us>" sets the scanout latency adjustment
+    if( r.compare(0, 9, ".latency ") == 0 )
+    {
+      cmd.type = CMD_LATENCY;
+      cmd.value = atoi(r.c_str() + 9);
+      queued = display_commands.push(cmd);
+    }
+    // ".layer <anim>" toggles a layer, ".layer" hides all
+    if( r.compare(0, 6, ".layer") == 0 && (r.size() == 6 || r[6] == ' ')
+        && r.size() < 7 + sizeof(cmd.name) )
+    {
+      cmd.type = CMD_LAYER;
+      if( r.size() > 7 ) memcpy(cmd.name, r.c_str() + 7, r.size() - 7);
+      queued = producer_commands.push(cmd);
+      if( queued ) WakeProducer();
+    }
+    // ".text <format>" and ".ring <format>" show live text, alone they hide it
+    if( (r.compare(0, 5, ".text") == 0 || r.compare(0, 5, ".ring") == 0)
+        && (r.size() == 5 || r[5] == ' ') && r.size() < 6 + sizeof(cmd.name) && text_font )
+    {
+      cmd.type = CMD_TEXT;
+      cmd.value = r[1] == 'r' ? TextLayer::RING : TextLayer::FLAT;
+      if( r.size() > 6 ) memcpy(cmd.name, r.c_str() + 6, r.size() - 6);
+      queued = producer_commands.push(cmd);
+      if( queued ) WakeProducer();
+    }
+  }
+  else if( r.size() < sizeof(cmd.name) )
+  {
+    cmd.type = CMD_CHANGE_ANIM;
+    memcpy(cmd.name, r.c_str(), r.size() + 1);
+    queued = producer_commands.push(cmd);
+    if( queued ) WakeProducer();
+  }
+  return queued;
+}
+
+// serial frames map onto the same commands as zmq requests
+static void HandleUart(const UartMessage &m)
+{
+  const uint32_t received_us = rgb_matrix::GetMicrosecondCounter();
+  switch( m.type )
+  {
+    case UART_STATE:
+      std::cout << "UART > state " << m.payload << std::endl;
+      if( !m.payload.empty() && m.payload[0] != '.' ) QueueRequest(m.payload, received_us);
+      break;
+    case UART_SWIPE:
+      std::cout << "UART > swipe " << m.payload << std::endl;
+      for( char d : m.payload )
+      {
+        if( d == 'L' ) QueueRequest(".l", received_us);
+        if( d == 'R' ) QueueRequest(".r", received_us);
+      }
+      break;
+    case UART_FILE: // uploads go through zmq
+    case UART_REFRESH:
+      break;
+  }
+}
+
+// swipes nudge the rotation like .l/.r, without a round trip through zmq
+static void HandleSwipe(char direction, uint64_t edge_us)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  const uint64_t now_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  QueueRequest(direction == 'L' ? ".l" : ".r", rgb_matrix::GetMicrosecondCounter());
+  printf("Swipe %s, queued %lluus after the edge\n", direction == 'L' ? "left" : "right",
+         (unsigned long long)(now_us - edge_us));
+}
+
+// answer every request waiting on the REP socket
+static void ServeRequests(zmq::socket_t *socket)
 {
-  zmq::socket_t* socket = (zmq::socket_t*)s;
   std::string ok = "OK";
   std::string fail = "FAIL";
 
-  // avoid blocking indefinitely
-  socket->set(zmq::sockopt::rcvtimeo, 300); // 100ms timeout
-
-  while(!interrupt_received)
+  // the zmq fd only signals edges, so drain while ZMQ_EVENTS says there is more
+  while( socket->get(zmq::sockopt::events) & ZMQ_POLLIN )
   {
     zmq::message_t request;
     
     // receive a request from client
-    if(socket->recv(request, zmq::recv_flags::none))
+    if(!socket->recv(request, zmq::recv_flags::dontwait)) break;
+
+    // uploads carry binary data after the first line, answered by the uploader
+    const char *data = static_cast<const char*>(request.data());
+    const char *eol = static_cast<const char*>(memchr(data, '\n', request.size()));
+    const std::string line(data, eol ? eol - data : request.size());
+    if( uploader && AnimUploader::Handles(line) )
+    {
+      const size_t skip = eol ? eol - data + 1 : request.size();
+      const std::string reply = uploader->Request(line, (const uint8_t*)data + skip, request.size() - skip);
+      if( line.compare(0, 7, ".chunk ") != 0 || reply != ok )
+        std::cout << "REQ > " << line << " < " << reply << std::endl;
+      socket->send(zmq::buffer(reply), zmq::send_flags::none);
+      continue;
+    }
+
+    std::string r = request.to_string();
+    std::cout << "REQ > " << r << std::endl;
+
+    const bool queued = QueueRequest(r, rgb_matrix::GetMicrosecondCounter());
+
+    // send the reply to the client
+    socket->send(zmq::buffer(queued ? ok : fail), zmq::send_flags::none);
+  }
+}
+
+// .anim files finished writing or moved into IMAGE_PATH get indexed by the producer
+static void WatchAnims(int inotify_fd)
+{
+  alignas(struct inotify_event) char buf[4096];
+  ssize_t n;
+  while( (n = read(inotify_fd, buf, sizeof(buf))) > 0 )
+  {
+    for( char *p = buf; p < buf + n; )
     {
-      std::string r = request.to_string();
-      std::cout << "REQ > " << r << std::endl;
+      const struct inotify_event *e = (const struct inotify_event*)p;
+      p += sizeof(struct inotify_event) + e->len;
+      if( e->len == 0 || fs::path(e->name).extension() != ".anim" ) continue;
+
+      Command cmd;
+      cmd.type = CMD_RELOAD;
+      cmd.received_us = rgb_matrix::GetMicrosecondCounter();
+      snprintf(cmd.name, sizeof(cmd.name), "%s", fs::path(e->name).stem().c_str());
+      if( producer_commands.push(cmd) ) WakeProducer();
+    }
+  }
+}
+
+// control thread: zmq requests, serial frames, new anims, stop signals and the cpu
+// report all arrive through one epoll, so nothing waits on a timeout
+enum ControlEvent { EV_ZMQ, EV_UART, EV_SWIPE, EV_SIGNAL, EV_FILES, EV_TIMER, EV_DISPLAY_LOG };
+
+static void WatchFd(int epoll_fd, int fd, ControlEvent tag)
+{
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u32 = tag;
+  if( fd >= 0 && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0 )
+    perror("epoll_ctl");
+}
 
-      if( r[0] == '.' )
+void control_loop(zmq::socket_t *socket, UartControl *uart, SwipeInput *swipe, bool report_cpu,
+                  const sigset_t &stop_signals)
+{
+  const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  const int signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  const int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if( inotify_fd >= 0 && inotify_add_watch(inotify_fd, IMAGE_PATH.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0 )
+    perror(IMAGE_PATH.c_str());
+  int timer_fd = -1;
+  if( report_cpu )
+  {
+    ReportThreadCPU();
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec period;
+    period.it_interval.tv_sec = CPU_REPORT / 1000;
+    period.it_interval.tv_nsec = (CPU_REPORT % 1000) * 1000000L;
+    period.it_value = period.it_interval;
+    timerfd_settime(timer_fd, 0, &period, NULL);
+  }
+
+  WatchFd(epoll_fd, socket->get(zmq::sockopt::fd), EV_ZMQ);
+  if( uart ) WatchFd(epoll_fd, uart->fd(), EV_UART);
+  if( swipe ) WatchFd(epoll_fd, swipe->fd(), EV_SWIPE);
+  WatchFd(epoll_fd, signal_fd, EV_SIGNAL);
+  WatchFd(epoll_fd, inotify_fd, EV_FILES);
+  WatchFd(epoll_fd, timer_fd, EV_TIMER);
+  WatchFd(epoll_fd, display_log_fd, EV_DISPLAY_LOG);
+
+  ServeRequests(socket); // may have queued before the first edge
+  while(!interrupt_received)
+  {
+    struct epoll_event events[8];
+    const int n = epoll_wait(epoll_fd, events, 8, -1);
+    if( n < 0 && errno != EINTR )
+    {
+      perror("epoll_wait");
+      break;
+    }
+
+    for( int e = 0; e < n; e++ )
+    {
+      switch( events[e].data.u32 )
       {
-        if( r == ".l" )
+        case EV_ZMQ:
+          ServeRequests(socket);
+          break;
+        case EV_UART:
+          // what was left is read before a hangup; out of the epoll before the fd closes
+          if( !uart->Read(HandleUart) || (events[e].events & (EPOLLHUP | EPOLLERR)) )
+          {
+            fprintf(stderr, "UART closed, control over zmq only\n");
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, uart->fd(), NULL);
+            uart->Close();
+          }
+          break;
+        case EV_SWIPE:
+          if( !swipe->Read(HandleSwipe) )
+          {
+            fprintf(stderr, "Swipe sensors gone\n");
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, swipe->fd(), NULL);
+            swipe->Close();
+          }
+          break;
+        case EV_SIGNAL:
         {
-          rot_off -= rot_inc;
+          struct signalfd_siginfo info;
+          if( read(signal_fd, &info, sizeof(info)) == sizeof(info) )
+          {
+            interrupt_received = true;
+            WakeProducer();
+          }
+          break;
         }
-        if( r == ".r" )
+        case EV_FILES:
+          WatchAnims(inotify_fd);
+          break;
+        case EV_TIMER:
         {
-          rot_off += rot_inc;
+          uint64_t expired;
+          if( read(timer_fd, &expired, sizeof(expired)) == sizeof(expired) ) ReportThreadCPU();
+          break;
+        }
+        case EV_DISPLAY_LOG:
+        {
+          eventfd_t queued;
+          eventfd_read(display_log_fd, &queued);
+          LogLine line;
+          while( display_log.pop(line) ) fprintf(line.error ? stderr : stdout, "%s\n", line.text);
+          break;
         }
-        if( r == ".n")
-          do_next_frame = true;
-      }
-      else
-      {
-        next_anim_name = &r;
-        do_change_anim = true;
       }
-      
-      // send the reply to the client
-      socket->send(zmq::buffer(ok), zmq::send_flags::none);
     }
-    std::this_thread::yield();
   }
+
+  if( timer_fd >= 0 ) close(timer_fd);
+  if( inotify_fd >= 0 ) close(inotify_fd);
+  if( signal_fd >= 0 ) close(signal_fd);
+  close(epoll_fd);
+}
+
+// pop the next frame of the current anim generation, dropping stale ones
+static bool PopCurrentFrame(SPSCQueue<MemFrame> &queue, MemFrame &out)
+{
+  const uint32_t generation = anim_generation.load();
+  bool found = false, popped = false;
+  while( !found && queue.pop(out) )
+  {
+    popped = true;
+    found = out.generation == generation;
+  }
+  if( popped ) WakeProducer(); // a slot is free
+  return found;
 }
 
 int main(int argc, char *argv[])
 {
+  const tmillis_t start_time = GetTimeInMillis();
+
+  // SIGINT/SIGTERM are read from a signalfd by the control thread; blocked before
+  // zmq, the matrix or any of our threads start, so none of them takes the signal
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
   RGBMatrix::Options matrix_options;
   rgb_matrix::RuntimeOptions runtime_opt;
 
@@ -421,10 +1356,6 @@ int main(int argc, char *argv[])
   zmq::context_t context(1);
   zmq::socket_t socket(context, zmq::socket_type::rep);
 
-  // todo: zmq SERVER
-  std::cout << "Binding ZMQ..." << std::endl;
-  socket.bind("tcp://*:5555");
-
   // If started with 'sudo': make sure to drop privileges to same user
   // we started with, which is the most expected (and allows us to read
   // files as that user).
@@ -433,27 +1364,154 @@ int main(int argc, char *argv[])
 
   rgb_matrix::ParseOptionsFromFlags(&argc, &argv,
                                     &matrix_options, &runtime_opt);
-  
-  // runtime_opt.do_gpio_init = true;
-  matrix = RGBMatrix::CreateFromOptions(matrix_options, runtime_opt);
-  if (matrix == NULL)
-    return 1;
+
+
+  int control_port = CONTROL_PORT;
+  HoloSync *sync = nullptr;
+  bool use_governor = false;
+  int commit_slice = 0;
+  int producer_core = -1, control_core = -1;
+  bool report_cpu = false;
+  const char *splash_font = NULL;
+  int splash_hold = 0; // ms
+  std::vector<std::string> layer_names;
+  const char *uart_device = NULL;
+  const char *swipe_device = NULL;
+  int uart_baud = UART_BAUD;
+  const char *spin_log = NULL;
+  bool compensate = true;
+  int32_t latency_adjust = 0; // us
+  bool live = false;
+  bool motor_aware = true;
+  int upsample = 1;
 
   int opt;
-  while ((opt = getopt(argc, argv, "r:")) != -1) {
+  while ((opt = getopt(argc, argv, "r:p:S:gc:P:C:uf:w:L:U:B:R:l:Mt:G:mA:")) != -1) {
     switch (opt) {
       case 'r': // directory
         rot_inc = atoi(optarg);
         break;
+      case 'p':
+        control_port = atoi(optarg);
+        break;
+      case 'S':
+        if( strcmp(optarg, "leader") == 0 )
+          sync = new HoloSync(HoloSync::SYNC_LEADER, "*");
+        else
+          sync = new HoloSync(HoloSync::SYNC_FOLLOWER, optarg);
+        break;
+      case 'g':
+        use_governor = true;
+        break;
+      case 'c':
+        commit_slice = atoi(optarg) < 0 ? -1 : SLICE_WRAP(atoi(optarg));
+        break;
+      case 'P':
+        producer_core = atoi(optarg);
+        break;
+      case 'C':
+        control_core = atoi(optarg);
+        break;
+      case 'u':
+        report_cpu = true;
+        break;
+      case 'f':
+        splash_font = optarg;
+        break;
+      case 'w':
+        splash_hold = atof(optarg) * 1000;
+        break;
+      case 'L':
+        layer_names.push_back(optarg);
+        break;
+      case 'U':
+        uart_device = optarg;
+        break;
+      case 'G':
+        swipe_device = optarg;
+        break;
+      case 'm':
+        motor_aware = false;
+        break;
+      case 'A':
+        upsample = std::max(1, std::min(UPSAMPLE_MAX, atoi(optarg)));
+        break;
+      case 'B':
+        uart_baud = atoi(optarg);
+        break;
+      case 'R':
+        spin_log = optarg;
+        break;
+      case 'l':
+        if( strcmp(optarg, "off") == 0 ) compensate = false;
+        else latency_adjust = atoi(optarg);
+        break;
+      case 'M':
+        live = true;
+        break;
+      case 't':
+        text_font = new rgb_matrix::Font();
+        if( !text_font->LoadFont(optarg) )
+        {
+          fprintf(stderr, "Couldn't load font '%s'\n", optarg);
+          return 1;
+        }
+        break;
       default:
         break;
     }
   }
+
+  // before the matrix drops privileges, the port usually belongs to root:dialout, the gpiochip to root:gpio,
+  // the log may go anywhere and /dev/shm may hold a stale ring owned by root
+  UartControl uart;
+  if( uart_device && !uart.Open(uart_device, uart_baud) ) return 1;
+  SwipeInput swipe;
+  if( swipe_device && !swipe.Open(swipe_device) ) return 1;
+  if( spin_log )
+  {
+    spin_recorder = new SpinRecorder();
+    if( !spin_recorder->Open(spin_log) ) return 1;
+  }
+  if( live )
+  {
+    volume_ring = new VolumeRing();
+    if( !volume_ring->Create(HOLO_SHM_NAME) ) return 1;
+  }
+
+  // runtime_opt.do_gpio_init = true;
+  matrix = RGBMatrix::CreateFromOptions(matrix_options, runtime_opt);
+  if (matrix == NULL)
+    return 1;
+
+  // todo: zmq SERVER
+  std::cout << "Binding ZMQ..." << std::endl;
+  socket.bind("tcp://*:" + std::to_string(control_port));
   
   printf( "REQUEST INPUTS: %lu\n", matrix->RequestInputs(1<<SPIN_SYNC) );
 
   offscreen_canvas = matrix->CreateFrameCanvas();
   reader_canvas = matrix->CreateFrameCanvas();
+  if( upsample > 1 ) upsampler = new SliceUpsampler(upsample, matrix->luminance_correct());
+
+  // the refresh thread keeps the splash up while this thread loads
+  bool splash = false;
+  if( splash_font )
+  {
+    rgb_matrix::Font font;
+    if( font.LoadFont(splash_font) )
+    {
+      DrawSplash(offscreen_canvas, font);
+      offscreen_canvas = matrix->SwapOnVSync(offscreen_canvas);
+      splash = true;
+    }
+    else
+      fprintf(stderr, "Couldn't load font '%s', no splash\n", splash_font);
+  }
+
+  QualityGovernor *governor = nullptr;
+  if( use_governor )
+    governor = new QualityGovernor(matrix); // picks how many of the converted planes are shown
   
   printf("Size: %dx%d. Hardware gpio mapping: %s\n",
          matrix->width(), matrix->height(), matrix_options.hardware_mapping);
@@ -461,7 +1519,7 @@ int main(int argc, char *argv[])
   const tmillis_t start_load = GetTimeInMillis();
   fprintf(stderr, "Loading files...\n");
 
-  // store animations in AnimList
+  // index animations in AnimList, files are opened when they start playing
   std::map< std::string, Anim > AnimList;
   int anim_count = RetrieveAnimList(AnimList);
   if( anim_count == 0)
@@ -470,93 +1528,350 @@ int main(int argc, char *argv[])
     return 1;
   }
 
-  fprintf(stderr, "Loading %d .anim files took %.3fs; now: Display.\n",
+  fprintf(stderr, "Indexing %d .anim files took %.3fs\n",
                   anim_count,
                   (GetTimeInMillis() - start_load) / 1000.0);
 
-  signal(SIGTERM, InterruptHandler);
-  signal(SIGINT, InterruptHandler);
-
-  size_t i = 0;
+  // convert the first idle frame here, so the first slice drawn is already content
+  const tmillis_t start_idle = GetTimeInMillis();
+  std::string startname = "idle";
+  if( AnimList.count(startname) == 0 )
+  {
+    startname = AnimList.begin()->first;
+    fprintf(stderr, "No idle.anim, starting with %s\n", startname.c_str());
+  }
+  Anim* active_anim(&AnimList[startname]);
+  if( !OpenAnim(*active_anim) ) return 1;
+
+  // plays the shared memory ring, never opened as a file
+  Anim live_anim;
+  live_anim.name = HOLO_SHM_ANIM;
+  live_anim.frameCount = 1;
+  live_anim.entry = std::make_shared<const AnimIndex>(AnimIndex{ live_anim.name, 1, 0 });
+
+  // owned by the producer once it runs
+  LayerStack layers;
+  for( const std::string &name : layer_names )
+    AddAnimLayer(AnimList, layers, name);
+
+  // frames change by swapping these pointers when the commit slice comes around,
+  // so a volume is never drawn half from one frame and half from the next
+  MemFrame frame_buffers[2];
+  MemFrame *active_frame = &frame_buffers[0];
+  MemFrame *pending_frame = &frame_buffers[1];
+  {
+    std::unique_ptr<SimpleFrame> data(new SimpleFrame());
+    ProduceFrame(*active_anim, *active_frame, *data, layers, GetTimeInMillis());
+    active_frame->generation = anim_generation.load();
+  }
+  fprintf(stderr, "First %s frame took %.3fs; now: Display.\n", startname.c_str(),
+          (GetTimeInMillis() - start_idle) / 1000.0);
+
+  // shown slices per turn: two per stored slice of a full turn anim, one per stored
+  // slice and one per mirrored one of an ANIM_HALF_TURN anim, times -A
+  size_t i = 0; // shown slice
+  const size_t shown_count = 2 * SLICE_COUNT * upsample;
+  const int per_slice = 2 * upsample; // shown slices per full turn slice, the unit of nudges
+  auto shown_wrap = [shown_count](size_t slice) { return slice % shown_count; };
   uint16_t prev_angle = 0;
   // uint16_t slice_angle = 0;
 
-  std::cout << "Starting ZMQ thread..." << std::endl;
-  zmq_thread = std::thread(zmq_loop, &socket);
+  // after privileges dropped, uploads belong to the user anims are read as
+  uploader = new AnimUploader(IMAGE_PATH);
 
-  SPSCQueue<MemFrame> readyQueue(QUEUE_SLOTS + 1);
+  display_log_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 
-  std::string startname = "idle";
-  Anim* active_anim(&AnimList[startname]);
-  active_anim_name = &startname;
+  std::cout << "Starting control thread..." << std::endl;
+  FunctionThread control_thread("holo-control", [&](){
+    control_loop(&socket, uart_device ? &uart : nullptr, swipe_device ? &swipe : nullptr, report_cpu, stop_signals);
+  });
+  control_thread.Start(0, control_core < 0 ? 0 : 1 << control_core);
+
+  SPSCQueue<MemFrame> readyQueue(QUEUE_SLOTS + 1);
 
   tmillis_t last_time = GetTimeInMillis();
 
-  MemFrame active_frame = EmptyFrame();
+  bool have_pending = false;
+  bool frame_due = false;
+  tmillis_t due_time = 0;
 
   // starts producer thread
-  std::thread producer([&](){
+  FunctionThread producer("holo-producer", [&](){
+    std::unique_ptr<SimpleFrame> data(new SimpleFrame());
+    uint32_t generation = anim_generation.load();
+    uint32_t pending_us = 0; // receipt time of last applied command
+    bool pending = false;
+    uint32_t live_head = 0; // ring head of the last live frame queued
+    bool live_dirty = false; // queue the newest live frame even if it was queued before
+    uint32_t live_frames = 0, live_torn = 0;
+
     while(!interrupt_received)
     {
-      if(do_change_anim)
+      Command cmd;
+      while(producer_commands.pop(cmd) || follower_commands.pop(cmd))
       {
-        if( AnimList.count(*next_anim_name) == 0 )
+        std::string name(cmd.name);
+        if( cmd.type == CMD_RELOAD )
+        {
+          if( AnimList.count(name) == 0 )
+          {
+            if( RetrieveAnimList(AnimList) > 0 ) printf("Indexed new anim %s\n", cmd.name);
+          }
+          else if( &AnimList[name] == active_anim )
+            active_anim->stale = true; // its open stream still reads the old file
+          else
+          {
+            if( ReindexAnim(AnimList[name]) ) printf("Indexed replaced anim %s\n", cmd.name);
+          }
+          continue;
+        }
+        if( cmd.type == CMD_LAYER || cmd.type == CMD_TEXT )
+        {
+          if( cmd.type == CMD_TEXT )
+          {
+            // queued frames show the old text, like for layers they are produced again
+            if( !SetTextLayer(layers, (TextLayer::Shape)cmd.value, name) ) continue;
+          }
+          else if( name.empty() ) layers.Clear();
+          else if( !layers.Remove(name) ) AddAnimLayer(AnimList, layers, name);
+          if( layers.empty() )
+            for( ComposedSlice &c : composed ) c = ComposedSlice();
+          // frames queued before the change are dropped by the display loop,
+          // produce again from the oldest one so the anim doesn't jump
+          MemFrame oldest;
+          if( readyQueue.front(oldest) && oldest.generation == generation && oldest.anim == active_anim
+              && active_anim != &live_anim )
+            SeekAnimFrame(*active_anim, oldest.index);
+          generation = anim_generation.fetch_add(1) + 1;
+          live_dirty = true;
+          pending_us = cmd.received_us;
+          pending = true;
+          continue;
+        }
+        if( cmd.type == CMD_SEEK_FRAME )
+        {
+          if( name != active_anim->name || (uint32_t)cmd.value >= active_anim->frameCount ) continue;
+          SeekAnimFrame(*active_anim, cmd.value);
+          generation = anim_generation.fetch_add(1) + 1;
+          continue;
+        }
+
+        if( volume_ring && name == HOLO_SHM_ANIM )
+        {
+          if( active_anim != &live_anim )
+          {
+            CloseAnim(*active_anim);
+            if( active_anim->stale ) ReindexAnim(*active_anim);
+          }
+          active_anim = &live_anim;
+          generation = anim_generation.fetch_add(1) + 1;
+          pending_us = cmd.received_us;
+          pending = true;
+          live_dirty = true;
+          continue;
+        }
+
+        if( AnimList.count(name) == 0 )
+        {
+          RetrieveAnimList(AnimList); // reload anim list
+        }
+        if( AnimList.count(name) != 0 )
         {
-          RetrieveAnimList(AnimList); // reload anim list        
+          Anim &next = AnimList[name];
+          if( &next != active_anim )
+          {
+            if( !OpenAnim(next) ) continue; // keep playing the current one
+            CloseAnim(*active_anim);
+            if( active_anim->stale ) ReindexAnim(*active_anim);
+            active_anim = &next;
+          }
+          SeekAnimFrame(*active_anim, 0);
+          // queued frames of the old anim are dropped by the display loop
+          generation = anim_generation.fetch_add(1) + 1;
+          pending_us = cmd.received_us;
+          pending = true;
         }
-        if( AnimList.count(*next_anim_name) != 0 )
+        else
         {
-          active_anim = &AnimList[*next_anim_name];
-          active_anim->frame = 0;
-          active_anim_name = next_anim_name;
-          readyQueue.clear();
+          fprintf(stderr, "No anim named \"%s\"\n", cmd.name);
         }
-        do_change_anim = false;
       }
 
-      if(readyQueue.isfull())
+      if( motor_idle )
       {
-        std::this_thread::yield();
+        // nothing is shown, frames would only wait in the queue
+        std::unique_lock<std::mutex> l(producer_mutex);
+        producer_wake.wait(l, [&](){
+          return !motor_idle || ProducerCommandsWaiting() || interrupt_received;
+        });
         continue;
       }
-    
-      // convert SimpleFrame to MemFrame for each frame
-      SimpleFrame data;
-      MemFrame next_frame;
-      active_anim->frame++;
-      if(active_anim->frame >= active_anim->frameCount)
-      {
-        active_anim->frame = active_anim->loopStart >= active_anim->frameCount ? active_anim->frameCount - 1 : active_anim->loopStart;
-        active_anim->stream.clear();  // clear EOF flag
-        active_anim->stream.seekg(active_anim->loopHead);
-      }
-      active_anim->stream.read(reinterpret_cast<char*>(&data), FRAME_SIZE);
 
-      // store each slice in stream
-      for(size_t k = 0; k < SLICE_COUNT; k++)
+      if( active_anim == &live_anim )
       {
-        rgb_matrix::StreamWriter out(&next_frame.slices[k]);
+        // one frame ahead at most, queued volumes would only age; sleep on the ring
+        // futex until the writer publishes, the display frees the slot or a command comes
+        const uint32_t seen = volume_ring->wake();
+        const uint32_t head = volume_ring->head();
+        if( !readyQueue.empty() || (!live_dirty && head == live_head) )
+        {
+          if( !ProducerCommandsWaiting() && !interrupt_received ) volume_ring->Wait(seen, SHM_POLL_MS);
+          continue;
+        }
 
-        for (size_t y = 0; y < SLICE_ROWS; ++y) {
-          for (size_t x = 0; x < SLICE_COLS; ++x) {
-            const Pixel p = data.slices[k].GetPixel(x, y);
-            reader_canvas->SetPixel(x, y, p.r, p.g, p.b);
-          }
+        MemFrame next_frame;
+        uint32_t frame_head;
+        if( !ProduceLiveFrame(live_anim, next_frame, *data, layers, frame_head) )
+        {
+          // the writer is in the slot or lapped the conversion; its publish bumps the
+          // futex past `seen`, so this only sleeps if that hasn't happened yet
+          live_torn++;
+          if( !ProducerCommandsWaiting() && !interrupt_received ) volume_ring->Wait(seen, SHM_POLL_MS);
+          continue;
         }
+        live_frames++;
+        live_head = frame_head; // the head of the frame converted, not of the check above
+        live_dirty = false;
+        next_frame.generation = generation;
+        next_frame.command_us = pending_us;
+        next_frame.has_command = pending;
+        pending = false;
+        readyQueue.push(next_frame);
+        continue;
+      }
 
-        out.Stream(*reader_canvas, 0); // out writes to StreamIO memf[k]
+      if( readyQueue.size() >= QueueDepth(*active_anim) )
+      {
+        // sleep until the display frees a slot or a command arrives
+        std::unique_lock<std::mutex> l(producer_mutex);
+        producer_wake.wait(l, [&](){
+          return readyQueue.size() < QueueDepth(*active_anim) || ProducerCommandsWaiting() || interrupt_received;
+        });
+        continue;
       }
+    
+      // convert SimpleFrame to MemFrame for each frame
+      MemFrame next_frame;
+      ProduceFrame(*active_anim, next_frame, *data, layers,
+                   GetTimeInMillis() + (tmillis_t)readyQueue.size() * FRAME_TIME);
+
+      next_frame.generation = generation;
+      next_frame.command_us = pending_us;
+      next_frame.has_command = pending;
+      pending = false;
 
       readyQueue.push(next_frame); // get next frame or leave unchanged if nothing new
-      std::this_thread::yield();
     }
+    if( volume_ring )
+      printf("Live frames: %u queued, %u dropped torn\n", live_frames, live_torn);
   });
+  producer.Start(0, producer_core < 0 ? 0 : 1 << producer_core);
+
+  if( sync ) sync->Start();
+
+  // the producer fills the queue meanwhile
+  while( splash && !interrupt_received && GetTimeInMillis() - start_time < splash_hold )
+    usleep(WAIT_TIMEOUT * 1000);
+
+  // frame clock shared with sync followers
+  int32_t rot_phase = 0; // sum of applied rotation nudges
+  SyncState sync_state;
+  sync_state.frame_time_ms = FRAME_TIME;
+  // follower state
+  uint32_t follow_clock = 0, seek_clock = 0;
+  MemFrame staged;
+  bool have_staged = false;
+  char requested_anim[sizeof(SyncTarget::anim)] = {0};
+  uint32_t sync_ticks = 0, sync_mismatch = 0;
+  uint64_t sync_err_sum = 0, sync_err_max = 0;
 
   std::cout << "Display begin" << std::endl;
+  bool next_frame_now = false;
+  bool first_slice = true;
+  bool report_pending = false; // report latency after next drawn slice
+  uint32_t report_us = 0;
+
+  // a slice shows from its swap until the next one; pick it for the angle the
+  // panel will be at halfway through, measured from selection
+  uint32_t latency_us = 0; // smoothed selection -> middle of display interval
+  int32_t lead_us = 0; // applied, follows latency_us + latency_adjust at LATENCY_SLEW
+  uint32_t select_us = 0, swap_us = 0, swap_prev_us = 0;
+  uint32_t shown_max_us = 0; // longest slice since the last report, shows stalls
+  tmillis_t latency_report = GetTimeInMillis();
+  MotorState motor_state = MOTOR_LOCKED; // as last acted on, what runs until told otherwise
   do {
-    uint16_t slice_angle = SLICE_WRAP(((rotation_current_angle() >> (ROTATION_PRECISION - 10)) * SLICE_COUNT) >> 10);
+    Command cmd;
+    while(display_commands.pop(cmd))
+    {
+      if( cmd.type == CMD_ROTATE )
+      {
+        rot_off += cmd.value * per_slice;
+        rot_phase += cmd.value;
+        if( sync && sync->role() == HoloSync::SYNC_LEADER )
+        {
+          sync_state.phase = rot_phase;
+          sync->Publish(sync_state);
+        }
+      }
+      else if( cmd.type == CMD_NEXT_FRAME )
+        next_frame_now = true;
+      else if( cmd.type == CMD_LATENCY )
+      {
+        latency_adjust = cmd.value;
+        compensate = true;
+      }
+      report_pending = true;
+      report_us = cmd.received_us;
+    }
+
+    if( compensate )
+    {
+      const int32_t target = std::max(0, (int32_t)latency_us + latency_adjust);
+      lead_us += std::max(-LATENCY_SLEW, std::min(LATENCY_SLEW, target - lead_us));
+    }
+    else
+      lead_us = 0;
+
+    const size_t prev_i = i;
+    select_us = rgb_matrix::GetMicrosecondCounter();
+    const uint32_t angle = (rotation_current_angle() + rotation.Lead(lead_us)) & ROTATION_MASK;
+
+    if( motor_aware && motor.state() != motor_state )
+    {
+      DisplayLog(false, "MOTOR %s -> %s", MotorMonitor::Name(motor_state), MotorMonitor::Name(motor.state()));
+      motor_state = motor.state();
+      // lost sync coasts on the last speed, a missed pulse shouldn't flash the panel
+      const bool idle = motor_state == MOTOR_STOPPED || motor_state == MOTOR_SPIN_UP;
+      if( idle && !motor_idle )
+      {
+        // a stopped panel would show one slice at full duty; the splash may stay
+        if( !first_slice )
+        {
+          offscreen_canvas->Clear();
+          offscreen_canvas = matrix->SwapOnVSync(offscreen_canvas);
+        }
+        matrix->SetLimitRefreshRate(MOTOR_IDLE_HZ);
+        motor_idle = true;
+      }
+      else if( !idle && motor_idle )
+      {
+        matrix->SetLimitRefreshRate(matrix_options.limit_refresh_rate_hz);
+        if( governor ) governor->Resume();
+        motor_idle = false;
+        WakeProducer();
+        last_time = GetTimeInMillis(); // the frame clock stood still
+      }
+    }
+    if( motor_idle )
+    {
+      // only the sync pin needs watching, slowly enough to leave the cpu alone
+      usleep(MOTOR_IDLE_POLL_US);
+      continue;
+    }
+    // 16 bits of angle, finer than the most shown slices (-A UPSAMPLE_MAX)
+    uint16_t slice_angle = shown_wrap(((angle >> (ROTATION_PRECISION - 16)) * shown_count) >> 16);
     if( prev_angle > slice_angle ) // wrap-around (decrement)
-      i += slice_angle + SLICE_COUNT - prev_angle;
+      i += slice_angle + shown_count - prev_angle;
     else // increment
       i += slice_angle - prev_angle;
     prev_angle = slice_angle;
@@ -570,7 +1885,7 @@ int main(int argc, char *argv[])
       }
       else // rot_off < 0
       {
-        if( i == 0 ) i = SLICE_COUNT - 1;
+        if( i == 0 ) i = shown_count - 1;
         else i--;
         rot_off++;
       }
@@ -578,27 +1893,211 @@ int main(int argc, char *argv[])
       // rot_off = 0;
     }
 
-    if( i >= SLICE_COUNT ) i = 0;
+    i = shown_wrap(i);
+
+    // did this step pass the commit slice (forward, not a backward nudge)
+    const size_t advanced = shown_wrap(i + shown_count - prev_i);
+    const size_t to_commit = shown_wrap(commit_slice * per_slice + shown_count - prev_i);
+    const bool passed_commit = advanced < shown_count / 2 && to_commit != 0 && to_commit <= advanced;
+
+    bool frame_boundary = false;
+    SyncTarget target;
+    if( sync && sync->role() == HoloSync::SYNC_FOLLOWER && sync->Expected(sync->Now(), &target) )
+    {
+      const bool same_anim = active_frame->entry && active_frame->entry->name == target.anim;
+      if( !same_anim && strcmp(target.anim, requested_anim) != 0 )
+      {
+        // follow the leader's anim
+        Command follow;
+        follow.type = CMD_CHANGE_ANIM;
+        follow.received_us = rgb_matrix::GetMicrosecondCounter();
+        memcpy(follow.name, target.anim, sizeof(target.anim));
+        if( follower_commands.push(follow) )
+        {
+          memcpy(requested_anim, target.anim, sizeof(target.anim));
+          WakeProducer();
+        }
+      }
+
+      // lock rotation offset to the leader, local nudges are undone
+      rot_off += (target.phase - rot_phase) * per_slice;
+      rot_phase = target.phase;
+
+      if( target.clock != follow_clock )
+      {
+        follow_clock = target.clock;
+
+        // show the leader's anim frame: skip ahead when behind, hold when ahead
+        bool found = false, hold = false;
+        for( int n = 0; n <= QUEUE_SLOTS; n++ )
+        {
+          if( have_staged && staged.generation != anim_generation.load() ) have_staged = false;
+          if( !have_staged && !PopCurrentFrame(readyQueue, staged) ) break;
+          have_staged = true;
+
+          int32_t d = -1;
+          if( staged.entry && staged.entry->name == target.anim )
+            d = AnimFrameDistance(target.index, staged.index, target.frameCount, target.loopStart);
+          if( d == 0 )
+          {
+            std::swap(*pending_frame, staged);
+            have_pending = true;
+            if( !frame_due ) due_time = GetTimeInMillis();
+            frame_due = true;
+            have_staged = false;
+            found = true;
+            break;
+          }
+          if( d > 0 && d <= 2 * SYNC_SEEK_LEAD )
+          {
+            hold = true;
+            break;
+          }
+          have_staged = false;
+        }
+
+        if( !found && !hold && same_anim && follow_clock - seek_clock > SYNC_SEEK_LEAD )
+        {
+          // leader's frame isn't queued, restart the producer a little ahead of it
+          Command seek;
+          seek.type = CMD_SEEK_FRAME;
+          seek.value = AnimFrameAfter(target.index, SYNC_SEEK_LEAD, target.frameCount, target.loopStart);
+          seek.received_us = rgb_matrix::GetMicrosecondCounter();
+          memcpy(seek.name, target.anim, sizeof(target.anim));
+          if( follower_commands.push(seek) )
+          {
+            seek_clock = follow_clock;
+            WakeProducer();
+          }
+        }
+
+        // how late this unit changed frame after the leader did
+        const uint64_t err = sync->Now() - target.tick_local_us;
+        sync_err_sum += err;
+        if( err > sync_err_max ) sync_err_max = err;
+        if( !found ) sync_mismatch++;
+        if( ++sync_ticks == SYNC_REPORT )
+        {
+          DisplayLog(false, "SYNC offset %lldus rtt %uus, frame error avg %lluus max %lluus, %u/%u frames mismatched",
+                 (long long)sync->offset_us(), sync->rtt_us(),
+                 (unsigned long long)(sync_err_sum / sync_ticks), (unsigned long long)sync_err_max,
+                 sync_mismatch, sync_ticks);
+          sync_ticks = sync_mismatch = 0;
+          sync_err_sum = sync_err_max = 0;
+        }
+      }
+    }
+    else
+    {
+      // stage the next frame so the commit is only a pointer swap
+      if( !have_pending ) have_pending = PopCurrentFrame(readyQueue, *pending_frame);
+
+      const tmillis_t now = GetTimeInMillis();
+      if( next_frame_now || now - last_time > FRAME_TIME )
+      {
+        // keep the frame rate: the schedule doesn't move with the commit delay
+        last_time = (next_frame_now || now - last_time > 2 * FRAME_TIME) ? now : last_time + FRAME_TIME;
+        next_frame_now = false;
+        if( !frame_due ) due_time = now;
+        frame_due = true;
+      }
+    }
+
+    if( frame_due && (commit_slice < 0 || passed_commit || GetTimeInMillis() - due_time > COMMIT_TIMEOUT) )
+    {
+      frame_due = false;
+      frame_boundary = true;
+      // skip a staged frame from before an anim switch
+      if( have_pending && pending_frame->generation != anim_generation.load() )
+        have_pending = PopCurrentFrame(readyQueue, *pending_frame);
+      if( have_pending )
+      {
+        std::swap(active_frame, pending_frame);
+        have_pending = false;
+      }
+
+      if( sync && sync->role() == HoloSync::SYNC_LEADER && active_frame->entry )
+      {
+        sync_state.clock++;
+        sync_state.tick_us = sync->Now();
+        sync_state.index = active_frame->index;
+        sync_state.frameCount = active_frame->entry->frameCount;
+        sync_state.loopStart = active_frame->entry->loopStart;
+        sync_state.phase = rot_phase;
+        snprintf(sync_state.anim, sizeof(sync_state.anim), "%s", active_frame->entry->name.c_str());
+        sync->Publish(sync_state);
+      }
+    }
 
-    if( GetTimeInMillis() - last_time > FRAME_TIME )
+    if( active_frame->has_command )
     {
-      last_time = GetTimeInMillis();
-      readyQueue.pop(active_frame);
+      active_frame->has_command = false;
+      report_pending = true;
+      report_us = active_frame->command_us;
     }
 
-    rgb_matrix::StreamReader reader(&active_frame.slices[i]);
+    if( governor && frame_boundary && governor->Update(rotation.period()) )
+      DisplayLog(false, "GOVERNOR: %s", governor->report());
+
+    const size_t per_half = SLICE_COUNT * upsample;
+    const bool behind = active_frame->half_turn && i >= per_half;
+    const size_t p = active_frame->half_turn ? i % per_half : i / 2;
+    const size_t stored = p / upsample, step = p % upsample;
+    const SliceStream *shown;
+    if( behind ) shown = step == 0 ? &active_frame->back[stored] : &active_frame->back_between[stored][step - 1];
+    else shown = step == 0 ? &active_frame->slices[stored] : &active_frame->between[stored][step - 1];
+    rgb_matrix::StreamReader reader((*shown ? *shown : active_frame->slices[stored]).get());
     while(!interrupt_received && reader.GetNext(offscreen_canvas, &d_us))
     {
+      if( governor && offscreen_canvas->pwmbits() != governor->pwm_bits() )
+        offscreen_canvas->SetPWMBits(governor->pwm_bits());
       offscreen_canvas = matrix->SwapOnVSync(offscreen_canvas, 1);
+      swap_prev_us = swap_us;
+      swap_us = rgb_matrix::GetMicrosecondCounter();
+      if( swap_prev_us != 0 )
+      {
+        const int32_t sample = (swap_us - select_us) + (swap_us - swap_prev_us) / 2;
+        latency_us += (sample - (int32_t)latency_us) / LATENCY_SMOOTHING;
+        shown_max_us = std::max(shown_max_us, swap_us - swap_prev_us);
+      }
+      if( governor ) governor->Sample();
+      if( first_slice )
+      {
+        first_slice = false;
+        DisplayLog(true, "Time to first slice: %.3fs", (GetTimeInMillis() - start_time) / 1000.0);
+      }
     }
     reader.Rewind();
+
+    if( GetTimeInMillis() - latency_report >= LATENCY_REPORT )
+    {
+      latency_report = GetTimeInMillis();
+      const uint32_t slice_us = std::max<uint32_t>(1, rotation.period() / (shown_count / 2)); // of a full turn anim
+      DisplayLog(false, "SCANOUT select->swap %uus, shown %uus (max %uus), dump %uus; lead %dus (%+dus) = %.2f slices",
+             swap_us - select_us, swap_us - swap_prev_us, shown_max_us, matrix->LastDumpMicros(),
+             lead_us, compensate ? latency_adjust : 0, (float)lead_us / slice_us);
+      shown_max_us = 0;
+    }
+
+    if( report_pending )
+    {
+      // command receipt -> first slice drawn with the new state
+      report_pending = false;
+      DisplayLog(false, "CMD latency: %uus", rgb_matrix::GetMicrosecondCounter() - report_us);
+    }
   } while (!interrupt_received);
 
   std::cout << "Ending display..." << std::endl;
 
   // shutdown
-  if(zmq_thread.joinable()) zmq_thread.join();
-  if(producer.joinable()) producer.join();
+  control_thread.WaitStopped();
+  producer.WaitStopped();
+  delete sync;
+  delete spin_recorder;
+  delete uploader;
+  delete volume_ring;
+  delete governor;
+  if( display_log_fd >= 0 ) close(display_log_fd);
   socket.close();
   for (auto& a : AnimList) {
       a.second.stream.close();
@@ -1,67 +1,94 @@
 #include "content-streamer.h"
+#include "led-matrix.h"
+#include "anim-format.h"
+#include "hologram-upsample.h"
+#include <array>
+#include <filesystem>
 #include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
-#define SLICE_ROWS 64
-#define SLICE_COLS 64
-#define SLICE_COUNT 100
+// converted slice, shared between frames that reference the same table slice
+typedef std::shared_ptr<rgb_matrix::MemStreamIO> SliceStream;
 
-// used in StreamIO construction
-struct Pixel
-{
-  Pixel() : r(0), g(0), b(0) {}
-  unsigned char r;
-  unsigned char g;
-  unsigned char b;
-  Pixel(unsigned char rn, unsigned char gn, unsigned char bn)
-  {
-    r = rn;
-    g = gn;
-    b = bn;
-  }
-};
+struct Anim;
 
-// used in StreamIO construction
-struct Slice
+// header fields of an anim the display thread reads; a replaced file gets a new one,
+// frames keep the one they were read with
+struct AnimIndex
 {
-  Pixel pixels[SLICE_ROWS * SLICE_COLS]; //1D collapsed row*COLUMNS + col
-  const Pixel GetPixel(size_t x, size_t y)
-  {
-    return pixels[ y * SLICE_COLS + x ];
-  }
-  void SetPixel(size_t x, size_t y,
-                unsigned char r,
-                unsigned char g,
-                unsigned char b)
-  {
-    pixels[ y * SLICE_COLS + x ] = Pixel(r,g,b);
-  }
+  std::string name;
+  uint32_t frameCount = 0;
+  uint32_t loopStart = 0;
 };
 
-struct SimpleFrame
+struct MemFrame
 {
-  Slice slices[SLICE_COUNT];
+  SliceStream slices[SLICE_COUNT];
+  SliceStream between[SLICE_COUNT][UPSAMPLE_MAX - 1]; // -A: shown after slices[k], empty otherwise
+  bool half_turn = false; // ANIM_HALF_TURN: slices cover half a turn, back the other half
+  SliceStream back[SLICE_COUNT]; // half_turn: slices[k] mirrored, shown half a turn later
+  SliceStream back_between[SLICE_COUNT][UPSAMPLE_MAX - 1]; // half_turn and -A: shown after back[k]
+  const Anim *anim = nullptr; // anim this frame was read from, compared by the producer only
+  std::shared_ptr<const AnimIndex> entry; // of anim when this frame was read
+  uint32_t index = 0; // frame number within anim
+  uint32_t generation = 0; // anim generation this frame was produced for
+  uint32_t command_us = 0; // receipt time of the command that produced it
+  bool has_command = false; // first frame after a command
 };
 
-struct MemFrame
+// control commands, queued from the control thread
+enum CommandType
 {
-  rgb_matrix::MemStreamIO slices[SLICE_COUNT];
+  CMD_CHANGE_ANIM, // producer: switch to anim `name`
+  CMD_NEXT_FRAME,  // display: advance to the next frame now
+  CMD_ROTATE,      // display: nudge rotation by `value` slices
+  CMD_SEEK_FRAME,  // producer: continue anim `name` at frame `value`
+  CMD_LAYER,       // producer: show anim `name` as a layer, hide it if shown; no name hides all
+  CMD_RELOAD,      // producer: index new .anim files, `name` was just written
+  CMD_LATENCY,     // display: set the scanout latency adjustment to `value` us
+  CMD_TEXT,        // producer: show format `name` as TextLayer::Shape `value`, hide it if empty
 };
 
-// .anim file
-struct AnimHeader
+struct Command
 {
-   char magic[9] = "HOLOGRAM"; // to recognize file (8+null)
-   uint32_t frameCount = 0;
-   uint32_t loopStart = 0; // frame to return to after last frame
+  CommandType type = CMD_NEXT_FRAME;
+  int32_t value = 0;
+  uint32_t received_us = 0; // GetMicrosecondCounter() at receipt
+  char name[64] = {0};
 };
 
 struct Anim
 {
   // std::vector<MemFrame> sequence;
-  std::ifstream stream;
+  std::string name;
+  std::filesystem::path path;
+  std::ifstream stream; // opened on first use, see OpenAnim()
   std::streampos headHead;
   std::streampos loopHead;
   uint32_t frame = 0; // current frame
   uint32_t frameCount = 0;
   uint32_t loopStart = 0; // end anim -> loop/idle frame
+  bool halfTurn = false; // ANIM_HALF_TURN
+  bool stale = false; // file replaced while playing, indexed again once closed
+  bool broken = false; // replaced by a file that can't be played, until it's replaced again
+  std::shared_ptr<const AnimIndex> entry; // published by ReadAnimFile()
+  bool slow = false; // a frame took longer to produce than FRAME_TIME, reported
+
+  // ANIM_SLICE_TABLE
+  uint32_t encoding = ANIM_RAW;
+  uint32_t tableCount = 0;
+  std::streampos tableHead;
+  std::vector<uint32_t> refs; // frameCount * SLICE_COUNT table indices
+  std::vector<bool> shared; // table slice referenced more than once
+  std::vector<SliceStream> cache; // converted shared slices of the active anim
+  // -A: converted slices between two shared slices, by their references (first << 32 | second)
+  std::unordered_map<uint64_t, std::array<SliceStream, UPSAMPLE_MAX - 1>> between;
+  uint32_t cached = 0; // streams in cache and between, at most SLICE_CACHE_MAX
+
+  // ANIM_PALETTE_TABLE, while open
+  std::vector<Pixel> colors; // ANIM_PALETTE_MAX entries
+  std::unique_ptr<rgb_matrix::FramePalette> palette;
 };
\ No newline at end of file
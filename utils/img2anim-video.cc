@@ -0,0 +1,308 @@
+/*
+* Video input for img2anim, see ./img2anim-video.h
+*
+* Demux and decode run on their own thread (the decoder itself may use several),
+* decoded frames wait in a short queue while the caller's thread scales them
+* into slices and writes finished frames.
+*/
+
+#include "img2anim-video.h"
+#include "av-scale.h"
+
+// Ancient AV versions forgot to set this.
+#define __STDC_CONSTANT_MACROS
+
+// libav: "U NO extern C in header ?"
+extern "C" {
+#  include <libavcodec/avcodec.h>
+#  include <libavformat/avformat.h>
+#  include <libavutil/imgutils.h>
+#  include <libswscale/swscale.h>
+}
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define VIDEO_QUEUE_FRAMES 32 // decoded frames waiting to be scaled
+
+static_assert(sizeof(Pixel) == 3, "slices are copied as AV_PIX_FMT_RGB24");
+
+struct VideoInput
+{
+  AVFormatContext *format = NULL;
+  AVCodecContext *codec = NULL;
+  int stream = -1;
+  bool failed = false; // decoding stopped on an error
+
+  ~VideoInput()
+  {
+    if( codec ) avcodec_free_context(&codec);
+    if( format ) avformat_close_input(&format);
+  }
+};
+
+// open `filename` and find its first video stream; the decoder is only set up when `threads` > 0
+static bool OpenVideo(const char *filename, int threads, VideoInput *in)
+{
+  if( avformat_open_input(&in->format, filename, NULL, NULL) != 0 )
+  {
+    fprintf(stderr, "%s: can't open video\n", filename);
+    return false;
+  }
+  if( avformat_find_stream_info(in->format, NULL) < 0 )
+  {
+    fprintf(stderr, "%s: couldn't find stream information\n", filename);
+    return false;
+  }
+
+  const AVCodec *av_codec = NULL;
+  for( int i = 0; i < (int)in->format->nb_streams; ++i )
+  {
+    const AVCodecParameters *params = in->format->streams[i]->codecpar;
+    if( params->codec_type != AVMEDIA_TYPE_VIDEO ) continue;
+    av_codec = avcodec_find_decoder(params->codec_id);
+    if( !av_codec ) continue;
+    in->stream = i;
+    break;
+  }
+  if( in->stream == -1 )
+  {
+    fprintf(stderr, "%s: no decodable video stream\n", filename);
+    return false;
+  }
+  if( threads <= 0 ) return true;
+
+  in->codec = avcodec_alloc_context3(av_codec);
+  if( threads > 1 )
+  {
+    in->codec->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    in->codec->thread_count = threads;
+  }
+  if( avcodec_parameters_to_context(in->codec, in->format->streams[in->stream]->codecpar) < 0
+      || avcodec_open2(in->codec, av_codec, NULL) < 0 )
+  {
+    fprintf(stderr, "%s: can't open decoder\n", filename);
+    return false;
+  }
+  return true;
+}
+
+int CountVideoFrames(const char *filename)
+{
+  VideoInput in;
+  if( !OpenVideo(filename, 0, &in) ) return -1;
+
+  // one packet per frame for video; cheaper than trusting nb_frames or the duration
+  int64_t packets = 0;
+  AVPacket *packet = av_packet_alloc();
+  while( av_read_frame(in.format, packet) == 0 )
+  {
+    if( packet->stream_index == in.stream ) packets++;
+    av_packet_unref(packet);
+  }
+  av_packet_free(&packet);
+  return packets / SLICE_COUNT;
+}
+
+// decoded frames between the decode thread and the scaler
+class FrameQueue
+{
+public:
+  ~FrameQueue()
+  {
+    for( AVFrame *f : frames_ ) av_frame_free(&f);
+  }
+
+  // false if the consumer stopped
+  bool Push(AVFrame *f)
+  {
+    std::unique_lock<std::mutex> l(m_);
+    cv_.wait(l, [&](){ return frames_.size() < VIDEO_QUEUE_FRAMES || stopped_; });
+    if( stopped_ ) return false;
+    frames_.push_back(f);
+    cv_.notify_all();
+    return true;
+  }
+
+  // NULL once the decoder is done and the queue is empty
+  AVFrame *Pop()
+  {
+    std::unique_lock<std::mutex> l(m_);
+    cv_.wait(l, [&](){ return !frames_.empty() || done_; });
+    if( frames_.empty() ) return NULL;
+    AVFrame *f = frames_.front();
+    frames_.pop_front();
+    cv_.notify_all();
+    return f;
+  }
+
+  void Done() { std::lock_guard<std::mutex> l(m_); done_ = true; cv_.notify_all(); }
+  void Stop() { std::lock_guard<std::mutex> l(m_); stopped_ = true; cv_.notify_all(); }
+
+private:
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::deque<AVFrame*> frames_;
+  bool done_ = false;
+  bool stopped_ = false;
+};
+
+// av_err2str() is a C compound literal
+static std::string AVError(int err)
+{
+  char buf[AV_ERROR_MAX_STRING_SIZE];
+  av_strerror(err, buf, sizeof(buf));
+  return buf;
+}
+
+static void DecodeVideo(VideoInput *in, FrameQueue *queue)
+{
+  AVPacket *packet = av_packet_alloc();
+  bool reading = true;
+  bool held = false; // `packet` read, the decoder hasn't taken it yet
+  bool draining = false;
+  bool consumer = true;
+
+  while( consumer )
+  {
+    if( reading && !held )
+    {
+      if( av_read_frame(in->format, packet) != 0 )
+        reading = false;
+      else if( packet->stream_index != in->stream )
+      {
+        av_packet_unref(packet);
+        continue;
+      }
+      else
+        held = true;
+    }
+
+    if( held || (!reading && !draining) )
+    {
+      // a NULL packet triggers the decode drain
+      const int sent = avcodec_send_packet(in->codec, held ? packet : nullptr);
+      if( sent != AVERROR(EAGAIN) ) // else the decoder is full, send again once its frames are taken
+      {
+        if( held )
+        {
+          av_packet_unref(packet);
+          held = false;
+        }
+        else
+          draining = true;
+        // a broken packet is skipped like ./video-viewer.cc does, anything else ends the decode
+        if( sent < 0 && sent != AVERROR_INVALIDDATA && sent != AVERROR_EOF )
+        {
+          fprintf(stderr, "decode error: %s\n", AVError(sent).c_str());
+          in->failed = true;
+          break;
+        }
+      }
+    }
+
+    int ret;
+    for( ;; )
+    {
+      AVFrame *f = av_frame_alloc();
+      ret = avcodec_receive_frame(in->codec, f);
+      if( ret != 0 )
+      {
+        av_frame_free(&f);
+        break;
+      }
+      if( !queue->Push(f) )
+      {
+        av_frame_free(&f);
+        consumer = false;
+        break;
+      }
+    }
+    if( draining && ret == AVERROR_EOF ) break;
+    if( ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF && ret != AVERROR_INVALIDDATA )
+    {
+      fprintf(stderr, "decode error: %s\n", AVError(ret).c_str());
+      in->failed = true;
+      break;
+    }
+  }
+
+  av_packet_free(&packet);
+  queue->Done();
+}
+
+int ConvertVideo(const char *filename, int frames, int threads,
+                 const std::function<void(const SimpleFrame&)> &write)
+{
+  VideoInput in;
+  if( !OpenVideo(filename, std::max(1, threads), &in) ) return -1;
+
+  // fit into a slice keeping the aspect ratio, black bars around
+  int width = in.codec->width;
+  int height = in.codec->height;
+  const float ratio = std::max(1.0f * width / SLICE_COLS, 1.0f * height / SLICE_ROWS);
+  width = std::max(1, std::min((int)SLICE_COLS, (int)roundf(width / ratio)));
+  height = std::max(1, std::min((int)SLICE_ROWS, (int)roundf(height / ratio)));
+  const int offset_x = (SLICE_COLS - width) / 2;
+  const int offset_y = (SLICE_ROWS - height) / 2;
+
+  SwsContext *const sws_ctx = CreateSWSContext(in.codec, width, height, SWS_AREA);
+  AVFrame *scaled = av_frame_alloc();
+  if( !sws_ctx || av_image_alloc(scaled->data, scaled->linesize,
+                                 width, height, AV_PIX_FMT_RGB24, 64) < 0 )
+  {
+    fprintf(stderr, "%s: can't scale %dx%d to %dx%d\n", filename,
+            in.codec->width, in.codec->height, width, height);
+    if( sws_ctx ) sws_freeContext(sws_ctx);
+    av_frame_free(&scaled);
+    return -1;
+  }
+
+  FrameQueue queue;
+  std::thread decoder(DecodeVideo, &in, &queue);
+
+  std::unique_ptr<SimpleFrame> frame(new SimpleFrame());
+  int written = 0;
+  size_t slice = 0;
+  while( written < frames )
+  {
+    AVFrame *f = queue.Pop();
+    if( f == NULL ) break;
+
+    sws_scale(sws_ctx, (uint8_t const * const *)f->data, f->linesize, 0, f->height,
+              scaled->data, scaled->linesize);
+    av_frame_free(&f);
+
+    // Pixel is packed rgb, same as AV_PIX_FMT_RGB24
+    Slice &s = frame->slices[slice];
+    for( int y = 0; y < height; ++y )
+    {
+      memcpy(&s.pixels[(y + offset_y) * SLICE_COLS + offset_x],
+             scaled->data[0] + y * scaled->linesize[0], width * sizeof(Pixel));
+    }
+
+    if( ++slice == SLICE_COUNT )
+    {
+      write(*frame);
+      written++;
+      slice = 0;
+    }
+  }
+
+  queue.Stop();
+  decoder.join();
+
+  av_freep(&scaled->data[0]);
+  av_frame_free(&scaled);
+  sws_freeContext(sws_ctx);
+  return in.failed ? -1 : written;
+}
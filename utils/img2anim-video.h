@@ -0,0 +1,25 @@
+/*
+* Video input for img2anim: every SLICE_COUNT decoded video frames are one
+* volumetric frame, e.g. a 360 degree turntable render.
+*
+* Built only with IMG2ANIM_VIDEO set (see: ./Makefile), needs libav like ./video-viewer.cc
+*/
+
+#ifndef IMG2ANIM_VIDEO_H
+#define IMG2ANIM_VIDEO_H
+
+#include "anim-format.h"
+
+#include <functional>
+
+// volumetric frames in the first video stream of `filename`, counted by demuxing
+// only; -1 if it can't be read
+int CountVideoFrames(const char *filename);
+
+// decode `filename` on `threads` decoder threads while the previous frames are
+// scaled and grouped, handing each full SimpleFrame to `write` in order.
+// stops after `frames` volumetric frames; returns frames written, -1 on error
+int ConvertVideo(const char *filename, int frames, int threads,
+                 const std::function<void(const SimpleFrame&)> &write);
+
+#endif
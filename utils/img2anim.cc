@@ -7,8 +7,22 @@
 
 * $ sudo apt-get install libgraphicsmagick++-dev libwebp-dev
 
-* usage: ./image-to-rgb -d <input folder> -o <output file> [-s <starting slice>]
-*/ 
+* images are decoded on a pool of threads (-j), frames are written in order
+* identical slices are stored once in a slice table (see: ./anim-format.h), -l writes the original layout
+* -p stores palette indices instead of colors, for content with at most 256 colors (a third of the size,
+* cheaper for the viewer to convert); fails if there are more
+* -H marks the slices as covering half a turn, slice k at 180*k/SLICE_COUNT degrees: the viewer shows
+* them mirrored for the other half, twice the angular resolution for the same size (ANIM_HALF_TURN)
+
+* -i can also be a video when built with IMG2ANIM_VIDEO (see: ./img2anim-video.h),
+* every SLICE_COUNT video frames become one frame
+
+* -q <pwm bits> dithers for a viewer running with --led-pwm-bits lower than 11 (see: ./anim-dither.h),
+* -b <brightness> if it runs with --led-brightness
+
+* usage: ./img2anim -i <input folder|video> -o <output file> [-s <loop frame> | -f <total frames>] [-j <threads>] [-l | -p]
+*                  [-H] [-q <pwm bits> [-b <brightness>]]
+*/
 
 #include <iostream>
 #include <fstream>
@@ -28,60 +42,27 @@
 #include <Magick++.h>
 #include <magick/image.h>
 
+#include "anim-format.h"
+#include "anim-writer.h"
+#include "anim-dither.h"
+#ifdef IMG2ANIM_VIDEO
+#include "img2anim-video.h"
+#endif
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
-#define SLICE_ROWS 64
-#define SLICE_COLS 64
-#define SLICE_COUNT 100
-
 namespace fs = std::filesystem;
 
-struct Pixel
-{
-  Pixel() : r(0), g(0), b(0) {}
-  unsigned char r;
-  unsigned char g;
-  unsigned char b;
-  Pixel(unsigned char rn, unsigned char gn, unsigned char bn)
-  {
-    r = rn;
-    g = gn;
-    b = bn;
-  }
-};
-
-struct Slice
-{
-  Pixel pixels[SLICE_ROWS * SLICE_COLS]; //1D collapsed row*COLUMNS + col
-  Pixel GetPixel(size_t x, size_t y)
-  {
-    return pixels[ y * SLICE_COLS + x ];
-  }
-  void SetPixel(size_t x, size_t y,
-                unsigned char r,
-                unsigned char g,
-                unsigned char b)
-  {
-    pixels[ y * SLICE_COLS + x ] = Pixel(r,g,b);
-  }
-};
-
-struct SimpleFrame
-{
-  Slice slices[SLICE_COUNT];
-};
-
-// .anim file
-struct AnimHeader
-{
-   char magic[9] = "HOLOGRAM"; // to recognize file (8+null)
-   uint32_t frameCount = 0;
-   uint32_t loopStart = 0; // frame to return to after last frame
-};
-
 // put sorted file list in given string vector
 static void GetFileList(std::vector<std::string> *file_list, std::string folder)
 {
@@ -105,7 +86,6 @@ static bool LoadImage(const char *filename,
                       Magick::Image *result,
                       std::string *err )
 {
-  std::cout << "\e[2K\r" << filename << std::endl;
   try
   {
     result->read(filename);
@@ -120,20 +100,96 @@ static bool LoadImage(const char *filename,
 
 void ImageToSlice(const Magick::Image *img, Slice *s)
 {
-  for (size_t y = 0; y < img->rows(); ++y) { // rows
-    for (size_t x = 0; x < img->columns(); ++x) { // columns
-      const Magick::Color &c = img->pixelColor(x, y);
-      if (c.alphaQuantum() < 255) {
-        // std::cout << std::to_string(ScaleQuantumToChar(c.redQuantum())) << std::endl;
-        unsigned char r = ScaleQuantumToChar(c.redQuantum());
-        unsigned char g = ScaleQuantumToChar(c.greenQuantum());
-        unsigned char b = ScaleQuantumToChar(c.blueQuantum());
-        s->SetPixel(x, y, r, g, b);
+  const size_t rows = std::min(img->rows(), (size_t)SLICE_ROWS);
+  const size_t cols = std::min(img->columns(), (size_t)SLICE_COLS);
+
+  // one pixel cache request instead of a Color per pixel
+  const PixelPacket *packets = img->getConstPixels(0, 0, img->columns(), rows);
+  if( packets == NULL ) return;
+
+  for (size_t y = 0; y < rows; ++y) { // rows
+    const PixelPacket *row = packets + y * img->columns();
+    for (size_t x = 0; x < cols; ++x) { // columns
+      const PixelPacket &c = row[x];
+      if (c.opacity < 255) { // Color::alphaQuantum() is the opacity
+        s->SetPixel(x, y,
+                    ScaleQuantumToChar(c.red),
+                    ScaleQuantumToChar(c.green),
+                    ScaleQuantumToChar(c.blue));
       }
     }
   }
 }
 
+// decode the SLICE_COUNT images of frame `f` into `frame`
+static void LoadFrame(const std::vector<std::string> &list, size_t f, SimpleFrame *frame)
+{
+  for( size_t k = 0; k < SLICE_COUNT; k++ )
+  {
+    const char* filename = list[f * SLICE_COUNT + k].c_str();
+    Magick::Image img;
+    std::string err;
+
+    if( LoadImage( filename, &img, &err) )
+    {
+      ImageToSlice( &img, &frame->slices[k] );
+    }
+    else
+    {
+      fprintf(stderr, "%s error: %s\n", filename, err.c_str());
+    }
+  }
+}
+
+// decode `frames` frames on `threads` workers and hand them to `write` in order
+static void ConvertFrames(const std::vector<std::string> &list, size_t frames, int threads,
+                          const std::function<void(const SimpleFrame&)> &write)
+{
+  const size_t max_ahead = threads * 2; // frames decoded but not yet written
+  std::mutex m;
+  std::condition_variable cv;
+  std::map<size_t, std::unique_ptr<SimpleFrame>> done;
+  size_t next_write = 0;
+  std::atomic<size_t> next_job(0);
+
+  std::vector<std::thread> workers;
+  for( int t = 0; t < threads; t++ )
+  {
+    workers.emplace_back([&](){
+      for( size_t f = next_job++; f < frames; f = next_job++ )
+      {
+        {
+          std::unique_lock<std::mutex> l(m);
+          cv.wait(l, [&](){ return f < next_write + max_ahead; });
+        }
+        std::unique_ptr<SimpleFrame> s(new SimpleFrame());
+        LoadFrame(list, f, s.get());
+        {
+          std::lock_guard<std::mutex> l(m);
+          done[f] = std::move(s);
+        }
+        cv.notify_all();
+      }
+    });
+  }
+
+  for( size_t f = 0; f < frames; f++ )
+  {
+    std::unique_ptr<SimpleFrame> s;
+    {
+      std::unique_lock<std::mutex> l(m);
+      cv.wait(l, [&](){ return done.count(f) != 0; });
+      s = std::move(done[f]);
+      done.erase(f);
+      next_write = f + 1;
+    }
+    cv.notify_all();
+    write(*s);
+  }
+
+  for( auto &w : workers ) w.join();
+}
+
 int main(int argc, char *argv[]) {
   Magick::InitializeMagick(*argv);
 
@@ -143,9 +199,15 @@ int main(int argc, char *argv[]) {
   std::string outpath;
   int arg_loopstart = -1;
   int arg_totalframes = -1;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  bool dedup = true;
+  bool palette = false;
+  uint32_t flags = 0;
+  int pwm_bits = 0; // no dithering
+  int brightness = 100;
 
   int opt;
-  while ((opt = getopt(argc, argv, "i:o:s:f:")) != -1) {
+  while ((opt = getopt(argc, argv, "i:o:s:f:j:lpHq:b:")) != -1) {
     switch (opt) {
       case 'i': // directory
         folderpath = optarg;
@@ -159,14 +221,42 @@ int main(int argc, char *argv[]) {
       case 'f':
         arg_totalframes = atoi(optarg);
         break;
+      case 'j':
+        threads = std::max(1, atoi(optarg));
+        break;
+      case 'l': // legacy layout, no slice table
+        dedup = false;
+        break;
+      case 'p':
+        palette = true;
+        break;
+      case 'H':
+        flags |= ANIM_HALF_TURN;
+        break;
+      case 'q':
+        pwm_bits = atoi(optarg);
+        break;
+      case 'b':
+        brightness = atoi(optarg);
+        break;
       default:
-        fprintf(stderr, "usage: %s -i <input folder> -o <output filename> [-s <loop frame> | -f <total frames>]\n", argv[0]);
+        fprintf(stderr, "usage: %s -i <input folder|video> -o <output filename> [-s <loop frame> | -f <total frames>] [-j <threads>] [-l | -p] [-H] [-q <pwm bits> [-b <brightness>]]\n", argv[0]);
         return 1;
         break;
     }
   }
 
   
+  if( !dedup && flags )
+  {
+    fprintf(stderr, "-l can't mark a half turn anim, it would play over a full turn\n");
+    return 1;
+  }
+  if( !dedup && palette )
+  {
+    fprintf(stderr, "-p can't be used with -l, the legacy layout has no slice table for a palette\n");
+    return 1;
+  }
   if( !fs::exists(folderpath) )
   {
     fprintf(stderr, "Input path \"%s\" does not exist\n", folderpath.c_str());
@@ -177,82 +267,107 @@ int main(int argc, char *argv[]) {
     fprintf(stderr, "Output path \"%s\" already exists\n", folderpath.c_str());
     return 1;
   }
-  if( !fs::is_directory(folderpath))
+  const bool video = !fs::is_directory(folderpath);
+#ifndef IMG2ANIM_VIDEO
+  if( video )
   {
-    fprintf(stderr, "Path \"%s\" is not a folder\n", folderpath.c_str());
+    fprintf(stderr, "Path \"%s\" is not a folder (video input needs IMG2ANIM_VIDEO)\n", folderpath.c_str());
     return 1;
   }
+#endif
 
   std::string anim_name = fs::path(folderpath).filename();
   
   std::vector<std::string> list;
-  GetFileList(&list, folderpath); // put sorted file list in vector
-
-  int frames = (int)list.size() / (int)SLICE_COUNT; // should truncate
-  int count = 0;
+  int frames = 0;
+  if( video )
+  {
+#ifdef IMG2ANIM_VIDEO
+    frames = CountVideoFrames(folderpath.c_str());
+    if( frames < 0 ) return 1;
+    std::cout << frames * SLICE_COUNT << " video frames found" << std::endl;
+#endif
+  }
+  else
+  {
+    GetFileList(&list, folderpath); // put sorted file list in vector
+    frames = (int)list.size() / (int)SLICE_COUNT; // should truncate
+  }
 
   if( arg_totalframes != -1 )
     frames = arg_totalframes < frames ? arg_totalframes : frames;
 
   std::cout << frames << " frames" << std::endl;
 
-  AnimHeader header;
-  header.frameCount = frames;
+  uint32_t loopStart;
   if( arg_loopstart == -1 )
-    header.loopStart = frames - 1;
+    loopStart = frames - 1;
   else
-    header.loopStart = arg_loopstart;
+    loopStart = arg_loopstart;
 
   // outpath.append(anim_name);
   // outpath.append(".anim");
 
   std::cout << "WRITING TO " << outpath << std::endl;
 
-  std::ofstream f(outpath, std::ios::out | std::ios::binary | std::ios::app);
-  f.write(reinterpret_cast<const char*>(&header), sizeof(AnimHeader));
-  
-  SimpleFrame *s = new SimpleFrame();
-
-  for(auto it = list.begin(); it != list.end() && count != (frames * SLICE_COUNT); ++it)
+  AnimWriter writer(outpath, frames, loopStart, dedup, palette, flags);
+  if( !writer.ok() )
   {
-    // size_t frame_num = count / (int)SLICE_COUNT;
-    // if( anim.size() < frame_num + 1) // should only need +1 frame every 100 slices
-    // {
-    //   anim.emplace_back(SimpleFrame());
-    // }
+    fprintf(stderr, "Can't open \"%s\" for writing\n", outpath.c_str());
+    return 1;
+  }
 
-    const char* filename = (const char*)it->c_str();
-    Magick::Image img;
-    std::string err;
+  const auto start = std::chrono::steady_clock::now();
 
-    if( LoadImage( filename, &img, &err) )
+  // frames arrive in order, so error can be carried from one to the next
+  std::unique_ptr<AnimDither> dither;
+  std::unique_ptr<SimpleFrame> dithered;
+  if( pwm_bits > 0 && pwm_bits < 11 )
+  {
+    dither.reset(new AnimDither(pwm_bits, brightness));
+    dithered.reset(new SimpleFrame());
+    std::cout << "dithering for " << pwm_bits << " pwm bits, brightness " << brightness << std::endl;
+  }
+
+  int converted = 0;
+  auto write = [&](const SimpleFrame &s){
+    if( dither )
     {
-      // ImageToSlice( &img, &anim[frame_num].slices[count % SLICE_COUNT] );
-      ImageToSlice( &img, &s->slices[count % SLICE_COUNT] );
+      *dithered = s;
+      dither->Apply(dithered.get());
+      writer.Write(*dithered);
     }
     else
     {
-      fprintf(stderr, "%s error: %s", filename, err.c_str());
-    }
-    count++;
-
-    if ( count % SLICE_COUNT == 0 )
-    {
-      if(count > 0)
-      {
-        f.write( reinterpret_cast<const char*>(s), sizeof(SimpleFrame) );
-        delete s;
-      }
-      s = new SimpleFrame();
+      writer.Write(s);
     }
+    converted++;
+    std::cout << "\e[2K\rframe " << converted << "/" << frames << std::flush;
+  };
+  if( video )
+  {
+#ifdef IMG2ANIM_VIDEO
+    if( ConvertVideo(folderpath.c_str(), frames, threads, write) < 0 ) return 1;
+#endif
+  }
+  else
+  {
+    ConvertFrames(list, frames, threads, write);
   }
+  std::cout << std::endl;
+  if( converted < frames )
+    fprintf(stderr, "Only %d of %d frames decoded, padding with blank frames\n", converted, frames);
+
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  fprintf(stderr, "%d %s in %.2fs (%.1f %s/s, %d threads)\n",
+          converted * SLICE_COUNT, video ? "video frames" : "images", seconds,
+          converted * SLICE_COUNT / std::max(seconds, 1e-6), video ? "video frames" : "images", threads);
 
-  // for( auto it = anim.begin(); it != anim.end(); ++it )
-  // {
-  //   SimpleFrame *s = &(*it);
-  //   f.write( reinterpret_cast<const char*>(s), sizeof(SimpleFrame) );
-  // }
-  f.close();
+  if( !writer.Finish() )
+  {
+    fprintf(stderr, "Error writing \"%s\"\n", outpath.c_str());
+    return 1;
+  }
 
   return 0;
 }
\ No newline at end of file
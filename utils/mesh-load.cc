@@ -0,0 +1,455 @@
+/*
+* Mesh files, see ./mesh-load.h
+*/
+
+#include "mesh-load.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+#define PLY_LIST_MAX 65536 // values in one ply list, a larger count is a corrupt file
+
+static unsigned char ToChannel(double c)
+{
+  return c <= 0 ? 0 : c >= 255 ? 255 : (unsigned char)(c + 0.5);
+}
+
+// colors given as 0..1, or as 0..255 by files that write them that way
+static Pixel FloatColor(double r, double g, double b)
+{
+  const double scale = (r > 1 || g > 1 || b > 1) ? 1 : 255;
+  return Pixel(ToChannel(r * scale), ToChannel(g * scale), ToChannel(b * scale));
+}
+
+// index of texture `path` in `mesh`, added on first use
+static int AddTexture(Mesh *mesh, const std::string &path)
+{
+  for( size_t i = 0; i < mesh->textures.size(); i++ )
+    if( mesh->textures[i].path == path ) return (int)i;
+  mesh->textures.emplace_back();
+  mesh->textures.back().path = path;
+  return (int)mesh->textures.size() - 1;
+}
+
+struct ObjMaterial
+{
+  Pixel color = Pixel(255, 255, 255);
+  int texture = -1;
+};
+
+// materials of .mtl file `path` into `materials`
+static void LoadMtl(const fs::path &path, Mesh *mesh, std::map<std::string, ObjMaterial> *materials)
+{
+  std::ifstream in(path);
+  if( !in )
+  {
+    fprintf(stderr, "%s: can't open, using white\n", path.c_str());
+    return;
+  }
+  std::string line, key;
+  ObjMaterial *current = nullptr;
+  while( std::getline(in, line) )
+  {
+    std::istringstream fields(line);
+    if( !(fields >> key) ) continue;
+    if( key == "newmtl" )
+    {
+      std::string name;
+      fields >> name;
+      current = &(*materials)[name];
+    }
+    else if( current && key == "Kd" )
+    {
+      double r = 1, g = 1, b = 1;
+      fields >> r >> g >> b;
+      current->color = FloatColor(r, g, b);
+    }
+    else if( current && key == "map_Kd" )
+    {
+      // options come first, the file name last
+      std::string token, file;
+      while( fields >> token ) file = token;
+      if( !file.empty() ) current->texture = AddTexture(mesh, (path.parent_path() / file).string());
+    }
+  }
+}
+
+// OBJ index `token` ("-1" counts from the end) into a list of `count`, -1 if out of range
+static long ObjIndex(const char *token, size_t count)
+{
+  const long i = strtol(token, nullptr, 10);
+  const long index = i < 0 ? (long)count + i : i - 1;
+  return index >= 0 && index < (long)count ? index : -1;
+}
+
+static bool LoadObj(const std::string &path, Mesh *mesh, std::string *err)
+{
+  std::ifstream in(path);
+  if( !in )
+  {
+    *err = "can't open";
+    return false;
+  }
+
+  std::vector<Pixel> colors; // per position
+  std::vector<bool> colored;
+  std::vector<float> uvs; // u, t pairs
+  std::map<std::string, ObjMaterial> materials;
+  ObjMaterial none;
+  const ObjMaterial *material = &none;
+
+  std::string line, key, corner;
+  size_t line_no = 0;
+  while( std::getline(in, line) )
+  {
+    line_no++;
+    std::istringstream fields(line);
+    if( !(fields >> key) || key[0] == '#' ) continue;
+
+    if( key == "v" )
+    {
+      MeshVertex v;
+      double r, g, b;
+      fields >> v.x >> v.y >> v.z;
+      mesh->positions.push_back(v);
+      const bool has_color = !!(fields >> r >> g >> b);
+      colors.push_back(has_color ? FloatColor(r, g, b) : Pixel());
+      colored.push_back(has_color);
+    }
+    else if( key == "vt" )
+    {
+      float u = 0, t = 0;
+      fields >> u >> t;
+      uvs.push_back(u);
+      uvs.push_back(t);
+    }
+    else if( key == "mtllib" )
+    {
+      std::string file;
+      std::getline(fields >> std::ws, file);
+      LoadMtl(fs::path(path).parent_path() / file, mesh, &materials);
+    }
+    else if( key == "usemtl" )
+    {
+      std::string name;
+      fields >> name;
+      material = materials.count(name) ? &materials[name] : &none;
+    }
+    else if( key == "f" )
+    {
+      // position and texture coordinate of each corner, "v", "v/vt", "v//vn" or "v/vt/vn"
+      std::vector<long> position, uv;
+      while( fields >> corner )
+      {
+        position.push_back(ObjIndex(corner.c_str(), mesh->positions.size()));
+        const size_t slash = corner.find('/');
+        const bool has_uv = slash != std::string::npos && slash + 1 < corner.size() && corner[slash + 1] != '/';
+        uv.push_back(has_uv ? ObjIndex(corner.c_str() + slash + 1, uvs.size() / 2) : -1);
+        if( position.back() < 0 )
+        {
+          *err = "line " + std::to_string(line_no) + ": vertex index out of range";
+          return false;
+        }
+      }
+      const bool textured = material->texture >= 0
+                            && std::find(uv.begin(), uv.end(), -1) == uv.end();
+      for( size_t c = 2; c < position.size(); c++ )
+      {
+        MeshTriangle tri;
+        const size_t corners[3] = { 0, c - 1, c };
+        for( int i = 0; i < 3; i++ )
+        {
+          const long p = position[corners[i]];
+          tri.v[i] = (uint32_t)p;
+          tri.color[i] = colored[p] ? colors[p] : material->color;
+          tri.u[i] = textured ? uvs[2 * uv[corners[i]]] : 0;
+          tri.t[i] = textured ? uvs[2 * uv[corners[i]] + 1] : 0;
+        }
+        tri.texture = textured ? material->texture : -1;
+        mesh->triangles.push_back(tri);
+      }
+    }
+  }
+  return true;
+}
+
+enum PlyType { PLY_NONE, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+
+static PlyType PlyTypeNamed(const std::string &name)
+{
+  if( name == "char" || name == "int8" ) return PLY_INT8;
+  if( name == "uchar" || name == "uint8" ) return PLY_UINT8;
+  if( name == "short" || name == "int16" ) return PLY_INT16;
+  if( name == "ushort" || name == "uint16" ) return PLY_UINT16;
+  if( name == "int" || name == "int32" ) return PLY_INT32;
+  if( name == "uint" || name == "uint32" ) return PLY_UINT32;
+  if( name == "float" || name == "float32" ) return PLY_FLOAT32;
+  if( name == "double" || name == "float64" ) return PLY_FLOAT64;
+  return PLY_NONE;
+}
+
+struct PlyProperty
+{
+  std::string name;
+  PlyType type = PLY_NONE;
+  PlyType count_type = PLY_NONE; // set for lists
+};
+
+struct PlyElement
+{
+  std::string name;
+  size_t count = 0;
+  std::vector<PlyProperty> properties;
+};
+
+// values of the ply body in its ascii or binary format
+class PlyReader
+{
+public:
+  PlyReader(std::istream &in, bool ascii, bool big_endian) : in_(in), ascii_(ascii)
+  {
+    const uint16_t one = 1;
+    swap_ = !ascii && big_endian != (*reinterpret_cast<const uint8_t*>(&one) == 0);
+  }
+
+  bool ok() const { return !!in_; }
+
+  double Read(PlyType type)
+  {
+    if( ascii_ )
+    {
+      double value = 0;
+      in_ >> value;
+      return value;
+    }
+    static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+    unsigned char bytes[8] = { 0 };
+    in_.read(reinterpret_cast<char*>(bytes), sizes[type]);
+    if( swap_ ) std::reverse(bytes, bytes + sizes[type]);
+    switch( type )
+    {
+      case PLY_INT8: return (int8_t)bytes[0];
+      case PLY_UINT8: return bytes[0];
+      case PLY_INT16: { int16_t v; memcpy(&v, bytes, 2); return v; }
+      case PLY_UINT16: { uint16_t v; memcpy(&v, bytes, 2); return v; }
+      case PLY_INT32: { int32_t v; memcpy(&v, bytes, 4); return v; }
+      case PLY_UINT32: { uint32_t v; memcpy(&v, bytes, 4); return v; }
+      case PLY_FLOAT32: { float v; memcpy(&v, bytes, 4); return v; }
+      case PLY_FLOAT64: { double v; memcpy(&v, bytes, 8); return v; }
+      default: return 0;
+    }
+  }
+
+private:
+  std::istream &in_;
+  const bool ascii_;
+  bool swap_;
+};
+
+static int PropertyIndex(const PlyElement &e, std::initializer_list<const char*> names)
+{
+  for( const char *name : names )
+    for( size_t i = 0; i < e.properties.size(); i++ )
+      if( e.properties[i].name == name ) return (int)i;
+  return -1;
+}
+
+static bool LoadPly(const std::string &path, Mesh *mesh, std::string *err)
+{
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  std::string line, key;
+  if( !std::getline(in, line) || line.compare(0, 3, "ply") != 0 )
+  {
+    *err = "not a ply file";
+    return false;
+  }
+
+  std::string format;
+  std::vector<PlyElement> elements;
+  int texture = -1;
+  while( std::getline(in, line) )
+  {
+    if( !line.empty() && line.back() == '\r' ) line.pop_back();
+    std::istringstream fields(line);
+    if( !(fields >> key) ) continue;
+    if( key == "end_header" ) break;
+    if( key == "format" ) fields >> format;
+    else if( key == "comment" )
+    {
+      std::string what, file;
+      if( fields >> what && what == "TextureFile" && std::getline(fields >> std::ws, file) )
+        texture = AddTexture(mesh, (fs::path(path).parent_path() / file).string());
+    }
+    else if( key == "element" )
+    {
+      elements.emplace_back();
+      fields >> elements.back().name >> elements.back().count;
+    }
+    else if( key == "property" && !elements.empty() )
+    {
+      PlyProperty p;
+      std::string type, count_type;
+      fields >> type;
+      if( type == "list" )
+      {
+        fields >> count_type >> type;
+        p.count_type = PlyTypeNamed(count_type);
+        if( p.count_type == PLY_NONE )
+        {
+          *err = "unknown type " + count_type;
+          return false;
+        }
+      }
+      p.type = PlyTypeNamed(type);
+      fields >> p.name;
+      if( p.type == PLY_NONE )
+      {
+        *err = "unknown type " + type;
+        return false;
+      }
+      elements.back().properties.push_back(p);
+    }
+  }
+  if( format != "ascii" && format != "binary_little_endian" && format != "binary_big_endian" )
+  {
+    *err = "unknown format " + format;
+    return false;
+  }
+
+  PlyReader reader(in, format == "ascii", format == "binary_big_endian");
+  std::vector<Pixel> colors;
+  std::vector<float> uvs;
+  bool colored = false, has_uv = false;
+  std::vector<double> values;
+  std::vector<std::vector<double>> lists;
+  for( const PlyElement &e : elements )
+  {
+    const bool vertex = e.name == "vertex", face = e.name == "face";
+    const int x = PropertyIndex(e, { "x" }), y = PropertyIndex(e, { "y" }), z = PropertyIndex(e, { "z" });
+    const int r = PropertyIndex(e, { "red", "r" }), g = PropertyIndex(e, { "green", "g" });
+    const int b = PropertyIndex(e, { "blue", "b" });
+    const int u = PropertyIndex(e, { "u", "s", "texture_u" }), t = PropertyIndex(e, { "v", "t", "texture_v" });
+    const int indices = PropertyIndex(e, { "vertex_indices", "vertex_index" });
+    const int texcoord = PropertyIndex(e, { "texcoord" });
+    if( vertex )
+    {
+      if( x < 0 || y < 0 || z < 0 )
+      {
+        *err = "vertex without x, y, z";
+        return false;
+      }
+      colored = r >= 0 && g >= 0 && b >= 0;
+      has_uv = u >= 0 && t >= 0;
+    }
+    if( face && indices < 0 )
+    {
+      *err = "face without vertex_indices";
+      return false;
+    }
+
+    values.resize(e.properties.size());
+    lists.resize(e.properties.size());
+    for( size_t n = 0; n < e.count && reader.ok(); n++ )
+    {
+      for( size_t i = 0; i < e.properties.size(); i++ )
+      {
+        const PlyProperty &p = e.properties[i];
+        if( p.count_type == PLY_NONE )
+        {
+          values[i] = reader.Read(p.type);
+          continue;
+        }
+        const double count = reader.Read(p.count_type);
+        if( !reader.ok() ) break;
+        if( !(count >= 0 && count <= PLY_LIST_MAX) || count != (size_t)count )
+        {
+          *err = e.name + " " + std::to_string(n) + ": bad " + p.name + " count";
+          return false;
+        }
+        lists[i].resize((size_t)count);
+        for( size_t c = 0; c < count; c++ ) lists[i][c] = reader.Read(p.type);
+      }
+
+      if( vertex )
+      {
+        MeshVertex v;
+        v.x = values[x];
+        v.y = values[y];
+        v.z = values[z];
+        mesh->positions.push_back(v);
+        if( colored )
+        {
+          // integer channels are 0..255, floating point ones 0..1
+          const double scale = e.properties[r].type >= PLY_FLOAT32 ? 255 : 1;
+          colors.push_back(Pixel(ToChannel(values[r] * scale), ToChannel(values[g] * scale),
+                                 ToChannel(values[b] * scale)));
+        }
+        if( has_uv )
+        {
+          uvs.push_back(values[u]);
+          uvs.push_back(values[t]);
+        }
+      }
+      else if( face )
+      {
+        const std::vector<double> &corner = lists[indices];
+        const bool wedge_uv = texcoord >= 0 && lists[texcoord].size() == 2 * corner.size();
+        const bool textured = texture >= 0 && (has_uv || wedge_uv);
+        for( size_t c = 2; c < corner.size(); c++ )
+        {
+          MeshTriangle tri;
+          const size_t corners[3] = { 0, c - 1, c };
+          for( int i = 0; i < 3; i++ )
+          {
+            const double p = corner[corners[i]];
+            if( p < 0 || p >= mesh->positions.size() )
+            {
+              *err = "face " + std::to_string(n) + ": vertex index out of range";
+              return false;
+            }
+            tri.v[i] = (uint32_t)p;
+            tri.color[i] = colored ? colors[tri.v[i]] : Pixel(255, 255, 255);
+            tri.u[i] = !textured ? 0 : wedge_uv ? lists[texcoord][2 * corners[i]] : uvs[2 * tri.v[i]];
+            tri.t[i] = !textured ? 0 : wedge_uv ? lists[texcoord][2 * corners[i] + 1] : uvs[2 * tri.v[i] + 1];
+          }
+          tri.texture = textured ? texture : -1;
+          mesh->triangles.push_back(tri);
+        }
+      }
+    }
+    if( !reader.ok() )
+    {
+      *err = "truncated " + e.name + " data";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool LoadMesh(const std::string &path, Mesh *mesh, std::string *err)
+{
+  std::string ext = fs::path(path).extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  bool loaded;
+  if( ext == ".obj" ) loaded = LoadObj(path, mesh, err);
+  else if( ext == ".ply" ) loaded = LoadPly(path, mesh, err);
+  else
+  {
+    *err = "not an .obj or .ply file";
+    return false;
+  }
+  if( loaded && mesh->triangles.empty() )
+  {
+    *err = "no faces";
+    return false;
+  }
+  return loaded;
+}
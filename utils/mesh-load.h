@@ -0,0 +1,56 @@
+/*
+* Triangle meshes for ./mesh2anim, read from .obj or .ply files
+*
+* OBJ: v (with optional r g b after x y z), vt, f (polygons are split into fans),
+*      mtllib/usemtl with Kd and map_Kd
+* PLY: ascii or binary; vertex x y z, red green blue (uchar or 0..1 float), u v
+*      (or s t, texture_u texture_v); face vertex_indices (or vertex_index) and an
+*      optional per-corner texcoord list; "comment TextureFile <image>"
+*
+* Every triangle corner carries its color: the vertex color when the file has one,
+* else the material's. A textured triangle shows its texture instead of colors.
+* Texture images are only named here, ./mesh2anim decodes them.
+*/
+
+#ifndef MESH_LOAD_H
+#define MESH_LOAD_H
+
+#include "anim-format.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+struct MeshVertex
+{
+  float x = 0, y = 0, z = 0; // y is up
+};
+
+struct MeshTexture
+{
+  std::string path;
+  int width = 0;
+  int height = 0;
+  std::vector<Pixel> pixels; // rows from the top, v = 1
+};
+
+struct MeshTriangle
+{
+  uint32_t v[3]; // into Mesh::positions
+  Pixel color[3];
+  float u[3], t[3]; // texture coordinates, when texture >= 0
+  int texture = -1; // into Mesh::textures
+};
+
+struct Mesh
+{
+  std::vector<MeshVertex> positions;
+  std::vector<MeshTriangle> triangles;
+  std::vector<MeshTexture> textures; // decoded by the caller
+};
+
+// read `path` by its extension; false with a reason in `err`
+bool LoadMesh(const std::string &path, Mesh *mesh, std::string *err);
+
+#endif
@@ -0,0 +1,193 @@
+/*
+* Mesh slicing, see ./mesh-slicer.h
+*/
+
+#include "mesh-slicer.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+bool LoadKeyframes(const std::string &path, std::vector<MeshKeyframe> *keys, std::string *err)
+{
+  std::ifstream in(path);
+  if( !in )
+  {
+    *err = "can't open";
+    return false;
+  }
+  std::string line;
+  size_t line_no = 0;
+  while( std::getline(in, line) )
+  {
+    line_no++;
+    std::istringstream fields(line.substr(0, line.find('#')));
+    MeshKeyframe key;
+    MeshTransform &m = key.transform;
+    if( !(fields >> key.frame) ) continue;
+    if( !(fields >> m.rotate[1]) )
+    {
+      *err = "line " + std::to_string(line_no) + ": no rotation";
+      return false;
+    }
+    fields >> m.rotate[0] >> m.rotate[2] >> m.scale >> m.translate[0] >> m.translate[1] >> m.translate[2];
+    if( !keys->empty() && key.frame <= keys->back().frame )
+    {
+      *err = "line " + std::to_string(line_no) + ": frames must be ascending";
+      return false;
+    }
+    keys->push_back(key);
+  }
+  return true;
+}
+
+MeshTransform KeyframeAt(const std::vector<MeshKeyframe> &keys, uint32_t frame)
+{
+  if( keys.empty() ) return MeshTransform();
+  if( frame <= keys.front().frame ) return keys.front().transform;
+  if( frame >= keys.back().frame ) return keys.back().transform;
+
+  size_t i = 1;
+  while( keys[i].frame <= frame ) i++;
+  const MeshTransform &a = keys[i - 1].transform, &b = keys[i].transform;
+  const float w = (float)(frame - keys[i - 1].frame) / (keys[i].frame - keys[i - 1].frame);
+  MeshTransform m;
+  for( int c = 0; c < 3; c++ )
+  {
+    m.rotate[c] = a.rotate[c] + (b.rotate[c] - a.rotate[c]) * w;
+    m.translate[c] = a.translate[c] + (b.translate[c] - a.translate[c]) * w;
+  }
+  m.scale = a.scale + (b.scale - a.scale) * w;
+  return m;
+}
+
+MeshSlicer::MeshSlicer(const Mesh &mesh, bool half_turn)
+  : mesh_(mesh), slice_angle_((half_turn ? M_PI : 2 * M_PI) / SLICE_COUNT)
+{
+  float lo[3] = { INFINITY, INFINITY, INFINITY }, hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+  for( const MeshVertex &v : mesh.positions )
+  {
+    const float p[3] = { v.x, v.y, v.z };
+    for( int c = 0; c < 3; c++ )
+    {
+      lo[c] = std::min(lo[c], p[c]);
+      hi[c] = std::max(hi[c], p[c]);
+    }
+  }
+  for( int c = 0; c < 3; c++ ) center_[c] = mesh.positions.empty() ? 0 : (lo[c] + hi[c]) / 2;
+
+  // largest size that fits the cylinder at any rotation about the axis
+  float radius = 0;
+  for( const MeshVertex &v : mesh.positions )
+    radius = std::max(radius, hypotf(v.x - center_[0], v.z - center_[2]));
+  const float half_height = mesh.positions.empty() ? 0 : (hi[1] - lo[1]) / 2;
+  fit_ = 1;
+  if( radius > 0 ) fit_ = (SLICE_COLS - 1) / 2.0f / radius;
+  if( half_height > 0 ) fit_ = std::min(fit_, (SLICE_ROWS - 1) / 2.0f / half_height);
+}
+
+void MeshSlicer::Place(const MeshTransform &transform, std::vector<Placed> *placed) const
+{
+  const float rx = transform.rotate[0] * M_PI / 180, ry = transform.rotate[1] * M_PI / 180;
+  const float rz = transform.rotate[2] * M_PI / 180;
+  const float cx = cosf(rx), sx = sinf(rx), cy = cosf(ry), sy = sinf(ry), cz = cosf(rz), sz = sinf(rz);
+  // Ry * Rx * Rz
+  const float m[3][3] = {
+    { cy * cz + sy * sx * sz, -cy * sz + sy * sx * cz, sy * cx },
+    { cx * sz, cx * cz, -sx },
+    { -sy * cz + cy * sx * sz, sy * sz + cy * sx * cz, cy * cx },
+  };
+  const float scale = fit_ * transform.scale;
+
+  placed->resize(mesh_.positions.size());
+  for( size_t i = 0; i < mesh_.positions.size(); i++ )
+  {
+    const MeshVertex &v = mesh_.positions[i];
+    const float p[3] = { (v.x - center_[0]) * scale, (v.y - center_[1]) * scale, (v.z - center_[2]) * scale };
+    Placed &out = (*placed)[i];
+    out.x = m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + transform.translate[0];
+    out.y = m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + transform.translate[1];
+    out.z = m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + transform.translate[2];
+    out.r = hypotf(out.x, out.z);
+  }
+}
+
+Pixel MeshSlicer::Sample(const MeshTriangle &tri, float w1, float w2) const
+{
+  const float w0 = 1 - w1 - w2;
+  if( tri.texture >= 0 && !mesh_.textures[tri.texture].pixels.empty() )
+  {
+    // nearest texel, repeating outside 0..1
+    const MeshTexture &tex = mesh_.textures[tri.texture];
+    const float u = tri.u[0] * w0 + tri.u[1] * w1 + tri.u[2] * w2;
+    const float t = tri.t[0] * w0 + tri.t[1] * w1 + tri.t[2] * w2;
+    const int x = std::min(tex.width - 1, (int)((u - floorf(u)) * tex.width));
+    const int y = std::min(tex.height - 1, (int)((1 - (t - floorf(t))) * tex.height));
+    return tex.pixels[(size_t)y * tex.width + x];
+  }
+  const Pixel &a = tri.color[0], &b = tri.color[1], &c = tri.color[2];
+  return Pixel(a.r * w0 + b.r * w1 + c.r * w2 + 0.5f,
+               a.g * w0 + b.g * w1 + c.g * w2 + 0.5f,
+               a.b * w0 + b.b * w1 + c.b * w2 + 0.5f);
+}
+
+void MeshSlicer::Draw(const std::vector<Placed> &placed, size_t k, Slice *out) const
+{
+  const double angle = slice_angle_ * k;
+  const float dx = cos(angle), dz = sin(angle); // along the plane
+  const float nx = -dz, nz = dx; // plane normal
+  const float spread = tan(slice_angle_ / 2); // reach per voxel from the axis
+  const float axis = (SLICE_COLS - 1) / 2.0f, middle = (SLICE_ROWS - 1) / 2.0f;
+
+  float depth[SLICE_ROWS * SLICE_COLS]; // distance from the plane of the pixel drawn
+  std::fill(depth, depth + SLICE_ROWS * SLICE_COLS, INFINITY);
+  *out = Slice();
+
+  for( const MeshTriangle &tri : mesh_.triangles )
+  {
+    const Placed &a = placed[tri.v[0]], &b = placed[tri.v[1]], &c = placed[tri.v[2]];
+    const float da = a.x * nx + a.z * nz, db = b.x * nx + b.z * nz, dc = c.x * nx + c.z * nz;
+    const float reach = std::max(MESH_MIN_REACH, std::max(a.r, std::max(b.r, c.r)) * spread);
+    if( (da > reach && db > reach && dc > reach) || (da < -reach && db < -reach && dc < -reach) )
+      continue;
+
+    const float ab = hypotf(hypotf(b.x - a.x, b.y - a.y), b.z - a.z);
+    const float ac = hypotf(hypotf(c.x - a.x, c.y - a.y), c.z - a.z);
+    const float bc = hypotf(hypotf(c.x - b.x, c.y - b.y), c.z - b.z);
+    const int n = std::max(1, (int)ceilf(std::max(ab, std::max(ac, bc)) / MESH_SAMPLE_STEP));
+    for( int i = 0; i <= n; i++ )
+    {
+      // the distance from the plane changes linearly along j, only sample where it's in reach
+      const float base = da + (db - da) * i / n, slope = (dc - da) / n;
+      int j0 = 0, j1 = n - i;
+      if( fabsf(slope) > 1e-9f )
+      {
+        float lo = (-reach - base) / slope, hi = (reach - base) / slope;
+        if( lo > hi ) std::swap(lo, hi);
+        if( lo > j1 || hi < j0 ) continue;
+        if( lo > j0 ) j0 = (int)ceilf(lo);
+        if( hi < j1 ) j1 = (int)floorf(hi);
+      }
+      else if( fabsf(base) > reach )
+        continue;
+
+      for( int j = j0; j <= j1; j++ )
+      {
+        const float w1 = (float)i / n, w2 = (float)j / n, w0 = 1 - w1 - w2;
+        const float px = a.x * w0 + b.x * w1 + c.x * w2;
+        const float py = a.y * w0 + b.y * w1 + c.y * w2;
+        const float pz = a.z * w0 + b.z * w1 + c.z * w2;
+        const float d = fabsf(px * nx + pz * nz), s = px * dx + pz * dz;
+        if( d > std::max(MESH_MIN_REACH, fabsf(s) * spread) ) continue;
+        const long x = lroundf(axis + s), y = lroundf(middle - py);
+        if( x < 0 || x >= SLICE_COLS || y < 0 || y >= SLICE_ROWS ) continue;
+        const size_t p = y * SLICE_COLS + x;
+        if( d >= depth[p] ) continue;
+        depth[p] = d;
+        out->pixels[p] = Sample(tri, w1, w2);
+      }
+    }
+  }
+}
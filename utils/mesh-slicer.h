@@ -0,0 +1,82 @@
+/*
+* Rasterizes a mesh surface into polar slices for ./mesh2anim
+*
+* Slice k is the plane through the vertical axis at 2*pi*k/SLICE_COUNT (pi*k/SLICE_COUNT
+* for ANIM_HALF_TURN anims), the axis running between the two middle columns. Slice
+* pixel (x, y) is the point x - (SLICE_COLS-1)/2 voxels along the plane from the axis
+* and (SLICE_ROWS-1)/2 - y above the middle row, the same geometry ./hologram-text.h
+* draws in.
+*
+* A slice stands for the wedge of the turn around its plane, so it shows the surface
+* up to half the angle to the next slice away (at least MESH_MIN_REACH voxels near the
+* axis). Triangles are sampled at MESH_SAMPLE_STEP along their edges, only in the strip
+* of each triangle within that reach; where several surfaces land on a pixel the one
+* nearest the plane shows. Surfaces are drawn unlit, in their vertex, material or
+* texture colors.
+*
+* The mesh is centered and fitted into the volume once, keyframes then move it
+* within the volume in voxels.
+*/
+
+#ifndef MESH_SLICER_H
+#define MESH_SLICER_H
+
+#include "mesh-load.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#define MESH_SAMPLE_STEP 0.5f // voxels between samples along a triangle
+#define MESH_MIN_REACH 0.5f // voxels from the plane a slice shows near the axis
+
+// placement of the fitted mesh: scaled, then rotated about z, x and y, then moved
+struct MeshTransform
+{
+  float rotate[3] = { 0, 0, 0 }; // degrees about x, y, z
+  float scale = 1;
+  float translate[3] = { 0, 0, 0 }; // voxels
+};
+
+struct MeshKeyframe
+{
+  uint32_t frame = 0;
+  MeshTransform transform;
+};
+
+// keyframe file: one "<frame> <rotate y> [<rotate x> <rotate z> <scale> <x> <y> <z>]"
+// per line, frames ascending, '#' starts a comment; false with a reason in `err`
+bool LoadKeyframes(const std::string &path, std::vector<MeshKeyframe> *keys, std::string *err);
+
+// the transform of `frame`, interpolated linearly between keyframes and held past the ends
+MeshTransform KeyframeAt(const std::vector<MeshKeyframe> &keys, uint32_t frame);
+
+class MeshSlicer
+{
+public:
+  struct Placed
+  {
+    float x, y, z; // volume voxels, y up from the middle row
+    float r; // distance from the axis
+  };
+
+  // `mesh` with its textures decoded must outlive the slicer
+  MeshSlicer(const Mesh &mesh, bool half_turn);
+
+  // vertex positions of a frame with `transform`
+  void Place(const MeshTransform &transform, std::vector<Placed> *placed) const;
+
+  // draw the surface around slice k of the `placed` mesh into `out`
+  void Draw(const std::vector<Placed> &placed, size_t k, Slice *out) const;
+
+private:
+  Pixel Sample(const MeshTriangle &tri, float w1, float w2) const;
+
+  const Mesh &mesh_;
+  const double slice_angle_; // between slice planes
+  float center_[3]; // of the mesh's bounding box
+  float fit_; // mesh units to voxels
+};
+
+#endif
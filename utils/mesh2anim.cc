@@ -0,0 +1,283 @@
+/* * mesh (.obj, .ply) -> binary (.anim), sliced directly without rendering images first
+* (see: ./mesh-load.h, ./mesh-slicer.h)
+
+* the mesh is centered and fitted into the volume; -k animates it with a keyframe file,
+* one line per keyframe, transforms in between interpolated:
+*   # frame  rotate y  [rotate x  rotate z  scale  x  y  z]   (degrees, voxels)
+*   0    0
+*   99   360
+* frames default to the last keyframe + 1, or 1 without -k
+
+* slices are rasterized on a pool of threads (-j), several frames at a time, frames are written in order
+* texture images are decoded with GraphicsMagick, like ./img2anim reads slices
+
+* $ sudo apt-get install libgraphicsmagick++-dev libwebp-dev
+
+* -p, -H, -q and -b as in ./img2anim
+
+* usage: ./mesh2anim -i <mesh> -o <output file> [-k <keyframes>] [-s <loop frame> | -f <total frames>] [-j <threads>] [-p]
+*                   [-H] [-q <pwm bits> [-b <brightness>]]
+*/
+
+#include <iostream>
+#include <filesystem>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <Magick++.h>
+#include <magick/image.h>
+
+#include "anim-format.h"
+#include "anim-writer.h"
+#include "anim-dither.h"
+#include "mesh-load.h"
+#include "mesh-slicer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+#define FRAMES_AHEAD 2 // frames sliced at once, all threads work on the first one's slices first
+
+// decode the mesh's texture images; a texture that can't be read leaves its triangles in their colors
+static void LoadTextures(Mesh *mesh)
+{
+  for( MeshTexture &tex : mesh->textures )
+  {
+    Magick::Image img;
+    try
+    {
+      img.read(tex.path);
+    }
+    catch (std::exception& e)
+    {
+      fprintf(stderr, "%s error: %s\n", tex.path.c_str(), e.what());
+      continue;
+    }
+    const PixelPacket *packets = img.getConstPixels(0, 0, img.columns(), img.rows());
+    if( packets == NULL ) continue;
+    tex.width = img.columns();
+    tex.height = img.rows();
+    tex.pixels.resize((size_t)tex.width * tex.height);
+    for( size_t p = 0; p < tex.pixels.size(); p++ )
+      tex.pixels[p] = Pixel(ScaleQuantumToChar(packets[p].red), ScaleQuantumToChar(packets[p].green),
+                            ScaleQuantumToChar(packets[p].blue));
+    std::cout << tex.path << ": " << tex.width << "x" << tex.height << " texture" << std::endl;
+  }
+}
+
+// slice `frames` frames on `threads` workers, one job per slice, and hand them to `write` in order
+static void SliceFrames(const MeshSlicer &slicer, const std::vector<MeshKeyframe> &keys, size_t frames,
+                        int threads, const std::function<void(const SimpleFrame&)> &write)
+{
+  struct Sliced
+  {
+    std::unique_ptr<SimpleFrame> frame;
+    std::vector<MeshSlicer::Placed> placed;
+    size_t left = SLICE_COUNT; // slices not drawn yet
+  };
+  std::mutex m;
+  std::condition_variable cv;
+  std::map<size_t, Sliced> sliced; // frames being worked on
+  size_t next_write = 0;
+  std::atomic<size_t> next_job(0);
+
+  std::vector<std::thread> workers;
+  for( int t = 0; t < threads; t++ )
+  {
+    workers.emplace_back([&](){
+      for( size_t job = next_job++; job < frames * SLICE_COUNT; job = next_job++ )
+      {
+        const size_t f = job / SLICE_COUNT, k = job % SLICE_COUNT;
+        Sliced *s;
+        {
+          std::unique_lock<std::mutex> l(m);
+          cv.wait(l, [&](){ return f < next_write + FRAMES_AHEAD; });
+          s = &sliced[f];
+          if( !s->frame )
+          {
+            // the first slice of a frame places the mesh, the others wait for it here
+            s->frame.reset(new SimpleFrame());
+            slicer.Place(KeyframeAt(keys, f), &s->placed);
+          }
+        }
+        slicer.Draw(s->placed, k, &s->frame->slices[k]);
+        {
+          std::lock_guard<std::mutex> l(m);
+          s->left--;
+        }
+        cv.notify_all();
+      }
+    });
+  }
+
+  for( size_t f = 0; f < frames; f++ )
+  {
+    std::unique_ptr<SimpleFrame> frame;
+    {
+      std::unique_lock<std::mutex> l(m);
+      cv.wait(l, [&](){ return sliced.count(f) != 0 && sliced[f].left == 0; });
+      frame = std::move(sliced[f].frame);
+      sliced.erase(f);
+      next_write = f + 1;
+    }
+    cv.notify_all();
+    write(*frame);
+  }
+
+  for( auto &w : workers ) w.join();
+}
+
+int main(int argc, char *argv[]) {
+  Magick::InitializeMagick(*argv);
+
+  std::string meshpath;
+  std::string outpath;
+  std::string keypath;
+  int arg_loopstart = -1;
+  int arg_totalframes = -1;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  bool palette = false;
+  uint32_t flags = 0;
+  int pwm_bits = 0; // no dithering
+  int brightness = 100;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:o:k:s:f:j:pHq:b:")) != -1) {
+    switch (opt) {
+      case 'i':
+        meshpath = optarg;
+        break;
+      case 'o':
+        outpath = optarg;
+        break;
+      case 'k':
+        keypath = optarg;
+        break;
+      case 's':
+        arg_loopstart = atoi(optarg);
+        break;
+      case 'f':
+        arg_totalframes = atoi(optarg);
+        break;
+      case 'j':
+        threads = std::max(1, atoi(optarg));
+        break;
+      case 'p':
+        palette = true;
+        break;
+      case 'H':
+        flags |= ANIM_HALF_TURN;
+        break;
+      case 'q':
+        pwm_bits = atoi(optarg);
+        break;
+      case 'b':
+        brightness = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s -i <mesh> -o <output filename> [-k <keyframes>] [-s <loop frame> | -f <total frames>] [-j <threads>] [-p] [-H] [-q <pwm bits> [-b <brightness>]]\n", argv[0]);
+        return 1;
+        break;
+    }
+  }
+
+  if( outpath.empty() || fs::exists(outpath) )
+  {
+    fprintf(stderr, "Output path \"%s\" is missing or already exists\n", outpath.c_str());
+    return 1;
+  }
+
+  Mesh mesh;
+  std::string err;
+  if( !LoadMesh(meshpath, &mesh, &err) )
+  {
+    fprintf(stderr, "%s: %s\n", meshpath.c_str(), err.c_str());
+    return 1;
+  }
+  std::cout << mesh.positions.size() << " vertices, " << mesh.triangles.size() << " triangles" << std::endl;
+  LoadTextures(&mesh);
+
+  std::vector<MeshKeyframe> keys;
+  if( !keypath.empty() && !LoadKeyframes(keypath, &keys, &err) )
+  {
+    fprintf(stderr, "%s: %s\n", keypath.c_str(), err.c_str());
+    return 1;
+  }
+
+  int frames = keys.empty() ? 1 : keys.back().frame + 1;
+  if( arg_totalframes > 0 )
+    frames = arg_totalframes;
+
+  std::cout << frames << " frames" << std::endl;
+
+  uint32_t loopStart;
+  if( arg_loopstart == -1 )
+    loopStart = frames - 1;
+  else
+    loopStart = arg_loopstart;
+
+  std::cout << "WRITING TO " << outpath << std::endl;
+
+  AnimWriter writer(outpath, frames, loopStart, true, palette, flags);
+  if( !writer.ok() )
+  {
+    fprintf(stderr, "Can't open \"%s\" for writing\n", outpath.c_str());
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  // frames arrive in order, so error can be carried from one to the next
+  std::unique_ptr<AnimDither> dither;
+  std::unique_ptr<SimpleFrame> dithered;
+  if( pwm_bits > 0 && pwm_bits < 11 )
+  {
+    dither.reset(new AnimDither(pwm_bits, brightness));
+    dithered.reset(new SimpleFrame());
+    std::cout << "dithering for " << pwm_bits << " pwm bits, brightness " << brightness << std::endl;
+  }
+
+  int converted = 0;
+  auto write = [&](const SimpleFrame &s){
+    if( dither )
+    {
+      *dithered = s;
+      dither->Apply(dithered.get());
+      writer.Write(*dithered);
+    }
+    else
+    {
+      writer.Write(s);
+    }
+    converted++;
+    std::cout << "\e[2K\rframe " << converted << "/" << frames << std::flush;
+  };
+  MeshSlicer slicer(mesh, (flags & ANIM_HALF_TURN) != 0);
+  SliceFrames(slicer, keys, frames, threads, write);
+  std::cout << std::endl;
+
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  fprintf(stderr, "%d slices in %.2fs (%.1f slices/s, %d threads)\n",
+          converted * SLICE_COUNT, seconds, converted * SLICE_COUNT / std::max(seconds, 1e-6), threads);
+
+  if( !writer.Finish() )
+  {
+    fprintf(stderr, "Error writing \"%s\"\n", outpath.c_str());
+    return 1;
+  }
+
+  return 0;
+}
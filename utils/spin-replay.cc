@@ -0,0 +1,269 @@
+/*
+* Replays SPIN_SYNC edge logs (hologram-viewer -R) through RotationEstimator and
+* MotorMonitor (see: ./hologram-rotation.h) as fast as possible and reports how well
+* they tracked
+*
+* The true angle is interpolated between consecutive falling edges. The estimator's
+* absolute offset is arbitrary (ROTATION_ZERO, the phase at start), so its mean
+* offset from the true angle at the same time is taken as the reference. Slice timing
+* follows the display loop: a slice is picked from the angle every <interval> us, for
+* the angle <lead> us ahead like the viewer's scanout latency compensation, and shows
+* <latency> us later. It's scored against the true angle then, so a lead that doesn't
+* match the latency shows up as a bias, and one that extrapolates badly through speed
+* changes as spread.
+*
+* usage: ./spin-replay [-i <interval us>] [-l <lead us>] [-L <latency us>] [-w <warmup turns>] <log>...
+*/
+
+#include "anim-format.h"
+#include "hologram-rotation.h"
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#define REPLAY_INTERVAL 200 // us between slice picks, about one refresh
+#define REPLAY_WARMUP ROTATION_HISTORY // turns before errors count
+#define SLICE_WRAP(slice) ((slice) % (SLICE_COUNT))
+
+struct Edge
+{
+  uint64_t us;
+  int level;
+};
+
+static bool ReadLog(const char *path, std::vector<Edge> *edges)
+{
+  FILE *f = fopen(path, "rb");
+  if( !f )
+  {
+    perror(path);
+    return false;
+  }
+  char magic[8];
+  if( fread(magic, 1, 8, f) != 8 || memcmp(magic, SPIN_LOG_MAGIC, 8) != 0 )
+  {
+    fprintf(stderr, "%s: not a spin log\n", path);
+    fclose(f);
+    return false;
+  }
+  uint32_t record;
+  uint64_t us = 0;
+  while( fread(&record, sizeof(record), 1, f) == 1 )
+  {
+    us += record >> 1;
+    edges->push_back({ us, (int)(record & 1) });
+  }
+  fclose(f);
+  return true;
+}
+
+static double Degrees(int64_t angle)
+{
+  return angle * 360.0 / ROTATION_FULL;
+}
+
+// signed difference of two angles, within half a turn
+static int32_t AngleDiff(uint32_t a, uint32_t b)
+{
+  return (int32_t)(((a - b) & ROTATION_MASK) ^ ROTATION_HALF) - ROTATION_HALF;
+}
+
+// true angle at `when`, interpolated between the turns around it; false outside them.
+// `turn` is the turn `when` falls in, it only moves forward
+static bool TrueAngle(const std::vector<uint64_t> &turns, uint64_t when, size_t *turn, uint32_t *angle)
+{
+  while( *turn + 1 < turns.size() && turns[*turn + 1] <= when ) (*turn)++;
+  if( when < turns[0] || *turn + 1 >= turns.size() ) return false;
+  const double period = turns[*turn + 1] - turns[*turn];
+  *angle = (uint32_t)((when - turns[*turn]) / period * ROTATION_FULL) & ROTATION_MASK;
+  return true;
+}
+
+static size_t SliceOf(uint32_t angle)
+{
+  return SLICE_WRAP(((angle >> (ROTATION_PRECISION - 10)) * SLICE_COUNT) >> 10);
+}
+
+static double Percentile(std::vector<double> &v, double p)
+{
+  if( v.empty() ) return 0;
+  const size_t k = std::min(v.size() - 1, (size_t)(p * v.size()));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k];
+}
+
+static void Replay(const char *path, uint32_t interval, uint32_t lead, uint32_t latency, int warmup)
+{
+  std::vector<Edge> edges;
+  if( !ReadLog(path, &edges) ) return;
+
+  // falling edges that count as turns, the same way the estimator filters them
+  std::vector<uint64_t> turns;
+  for( const Edge &e : edges )
+  {
+    if( e.level != 0 ) continue;
+    if( !turns.empty() && e.us - turns.back() <= ROTATION_MIN_PERIOD ) continue;
+    turns.push_back(e.us);
+  }
+  if( turns.size() < (size_t)warmup + 2 )
+  {
+    fprintf(stderr, "%s: %zu turns, need more than %d\n", path, turns.size(), warmup + 1);
+    return;
+  }
+
+  const clock_t start = clock();
+  RotationEstimator rotation;
+  MotorMonitor motor;
+  MotorState motor_state = motor.state();
+  uint64_t locked_us = 0, first_lock = 0, prev_t = edges[0].us;
+  uint32_t losses = 0;
+  std::vector<int32_t> phases; // estimated - true angle at the same time
+  std::vector<int32_t> offsets; // picked - true angle when shown
+  std::vector<double> dwell; // time on a slice / ideal slice time
+  uint64_t samples = 0, steps = 0, skipped = 0, backwards = 0;
+  size_t prev_slice = SLICE_COUNT, turn = 0, now_turn = 0;
+  uint64_t slice_since = 0;
+  int level = edges[0].level;
+  size_t e = 0;
+
+  for( uint64_t t = edges[0].us; t < turns.back(); )
+  {
+    // the loop sees an edge at its recorded time, otherwise samples every interval
+    uint64_t next = t + interval;
+    if( e < edges.size() && edges[e].us <= next )
+    {
+      next = edges[e].us;
+      level = edges[e++].level;
+    }
+    t = next;
+    const uint32_t estimate = rotation.Update((uint32_t)t, level);
+    const uint32_t angle = (estimate + rotation.Lead(lead)) & ROTATION_MASK;
+    if( motor_state == MOTOR_LOCKED ) locked_us += t - prev_t;
+    prev_t = t;
+    if( motor.Update((uint32_t)t, level) != motor_state )
+    {
+      motor_state = motor.state();
+      if( motor_state == MOTOR_LOST ) losses++;
+      if( motor_state == MOTOR_LOCKED && first_lock == 0 ) first_lock = t;
+    }
+    uint32_t now_truth = 0, truth = 0;
+    const bool now_known = TrueAngle(turns, t, &now_turn, &now_truth);
+    if( !now_known || !TrueAngle(turns, t + latency, &turn, &truth) || now_turn < (size_t)warmup ) continue;
+    samples++;
+
+    const double period = turns[turn + 1] - turns[turn];
+    phases.push_back(AngleDiff(estimate, now_truth));
+    offsets.push_back(AngleDiff(angle, truth));
+
+    const size_t slice = SliceOf(angle);
+    if( slice == prev_slice ) continue;
+    if( prev_slice != SLICE_COUNT )
+    {
+      const size_t step = SLICE_WRAP(slice + SLICE_COUNT - prev_slice);
+      steps++;
+      if( step >= SLICE_COUNT / 2 ) backwards++;
+      else skipped += step - 1;
+      dwell.push_back((t - slice_since) / (period / SLICE_COUNT));
+    }
+    prev_slice = slice;
+    slice_since = t;
+  }
+  const double cpu_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  // deviation of the shown angle from the estimator's mean phase
+  const int32_t ref = phases.empty() ? 0 : phases[0];
+  double sum = 0;
+  for( int32_t o : phases ) sum += AngleDiff(o, ref);
+  const int32_t mean = ref + (int32_t)(sum / std::max<size_t>(1, phases.size()));
+  std::vector<double> err;
+  double bias = 0, abs_sum = 0, sq = 0, max_err = 0;
+  for( int32_t o : offsets )
+  {
+    const double signed_d = Degrees(AngleDiff(o, mean));
+    const double d = fabs(signed_d);
+    bias += signed_d;
+    err.push_back(d);
+    abs_sum += d;
+    sq += d * d;
+    max_err = std::max(max_err, d);
+  }
+
+  double dwell_sum = 0, dwell_sq = 0;
+  for( double d : dwell ) { dwell_sum += d; dwell_sq += d * d; }
+  const double dwell_mean = dwell.empty() ? 0 : dwell_sum / dwell.size();
+  const double dwell_sd = dwell.empty() ? 0 : sqrt(std::max(0.0, dwell_sq / dwell.size() - dwell_mean * dwell_mean));
+
+  std::vector<double> periods;
+  for( size_t k = warmup; k + 1 < turns.size(); k++ ) periods.push_back(turns[k + 1] - turns[k]);
+  double period_sum = 0;
+  for( double p : periods ) period_sum += p;
+  const double period_mean = period_sum / periods.size();
+  const double replayed_s = (turns.back() - edges[0].us) / 1e6;
+  const double slice_deg = 360.0 / SLICE_COUNT;
+
+  printf("%s: %zu edges, %zu turns over %.1fs, replayed in %.3fs (%.0fx)\n", path,
+         edges.size(), turns.size(), replayed_s, cpu_s, cpu_s > 0 ? replayed_s / cpu_s : 0);
+  printf("  period   mean %.0fus (%.0f rpm), min %.0fus, max %.0fus\n", period_mean,
+         60e6 / period_mean, *std::min_element(periods.begin(), periods.end()),
+         *std::max_element(periods.begin(), periods.end()));
+  printf("  angle    offset %.2f deg, shown %+.2f deg off; error mean %.2f rms %.2f p95 %.2f max %.2f deg (%.2f slices max)\n",
+         Degrees(mean), bias / std::max<size_t>(1, err.size()), abs_sum / std::max<size_t>(1, err.size()), sqrt(sq / std::max<size_t>(1, err.size())), Percentile(err, 0.95), max_err, max_err / slice_deg);
+  printf("  motor    locked %.1f%% of the time, first after %.2fs, lost sync %u times\n",
+         100.0 * locked_us / std::max<uint64_t>(1, turns.back() - edges[0].us),
+         first_lock ? (first_lock - edges[0].us) / 1e6 : 0.0, losses);
+  printf("  slices   %llu samples, %llu changes, %llu skipped, %llu backwards, dwell %.2f +- %.2f of ideal\n",
+         (unsigned long long)samples, (unsigned long long)steps, (unsigned long long)skipped,
+         (unsigned long long)backwards, dwell_mean, dwell_sd);
+}
+
+static int usage(const char *progname)
+{
+  fprintf(stderr, "usage: %s [options] <log>...\n", progname);
+  fprintf(stderr, "Replays hologram-viewer -R spin logs through the rotation estimator.\n");
+  fprintf(stderr, "Options:\n"
+          "\t-i <us>    : time between slice picks (default %d)\n"
+          "\t-l <us>    : pick slices for the angle this far ahead (default 0)\n"
+          "\t-L <us>    : scanout latency, slices show this long after the pick (default 0)\n"
+          "\t-w <turns> : turns to skip before measuring (default %d)\n",
+          REPLAY_INTERVAL, REPLAY_WARMUP);
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t interval = REPLAY_INTERVAL;
+  uint32_t lead = 0;
+  uint32_t latency = 0;
+  int warmup = REPLAY_WARMUP;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:l:L:w:")) != -1) {
+    switch (opt) {
+      case 'i':
+        interval = std::max(1, atoi(optarg));
+        break;
+      case 'l':
+        lead = std::max(0, atoi(optarg));
+        break;
+      case 'L':
+        latency = std::max(0, atoi(optarg));
+        break;
+      case 'w':
+        warmup = std::max(0, atoi(optarg));
+        break;
+      default:
+        return usage(argv[0]);
+    }
+  }
+  if( optind >= argc ) return usage(argv[0]);
+
+  for( int i = optind; i < argc; i++ ) Replay(argv[i], interval, lead, latency, warmup);
+  return 0;
+}